@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <string>
+#include "tree_node.hpp"
 
 class ArtMode {
 private:
@@ -22,68 +23,75 @@ public:
     
     void display(const std::string& msg) const {
         if (enabled) {
-            std::cout << " " << std::endl;
-            std::cout << "|| " << msg << "||" << std::endl;
+            console() << " " << std::endl;
+            console() << "|| " << msg << "||" << std::endl;
         } else {
-            std::cout << msg << "\n";
+            console() << msg << "\n";
         }
     }
 
     void show_welcome() const {
-        std::cout << "   .--.                                 " << std::endl;
-        std::cout << " .-(    ).             _.__            .--.      " << std::endl;
-        std::cout << "(___.__)__)       .--./    `        .-(    ).       " << std::endl;
-        std::cout << "                /              |  (___.__)__)   " << std::endl;
-        std::cout << "  _    _      _             \\ .-- . /           " << std::endl;
-        std::cout << " | |  | |    | |          __/       \\__       " << std::endl;
-        std::cout << " | |  | | ___| | ___ ___  _ __ ___   ___ " << std::endl;
-        std::cout << " | |/\\| |/ _ \\ |/ __/ _ \\| '_ ` _ \\ / _ \\" << std::endl;
-        std::cout << " \\  /\\  /  __/ | (_| (_) | | | | | |  __/" << std::endl;
-        std::cout << "  \\/  \\/ \\___|_|\\___\\___/|_| |_| |_|\\___|" << std::endl;
-        std::cout << "____________[ ART MODE IS ON ]_____________" << std::endl;
-        std::cout << "        .--.            .--.            " << std::endl;
-        std::cout << "     .-(    ).      .-(    ).          " << std::endl;
-        std::cout << "    (___.__)__)    (___.__)__)         " << std::endl;
+        console() << "   .--.                                 " << std::endl;
+        console() << " .-(    ).             _.__            .--.      " << std::endl;
+        console() << "(___.__)__)       .--./    `        .-(    ).       " << std::endl;
+        console() << "                /              |  (___.__)__)   " << std::endl;
+        console() << "  _    _      _             \\ .-- . /           " << std::endl;
+        console() << " | |  | |    | |          __/       \\__       " << std::endl;
+        console() << " | |  | | ___| | ___ ___  _ __ ___   ___ " << std::endl;
+        console() << " | |/\\| |/ _ \\ |/ __/ _ \\| '_ ` _ \\ / _ \\" << std::endl;
+        console() << " \\  /\\  /  __/ | (_| (_) | | | | | |  __/" << std::endl;
+        console() << "  \\/  \\/ \\___|_|\\___\\___/|_| |_| |_|\\___|" << std::endl;
+        console() << "____________[ ART MODE IS ON ]_____________" << std::endl;
+        console() << "        .--.            .--.            " << std::endl;
+        console() << "     .-(    ).      .-(    ).          " << std::endl;
+        console() << "    (___.__)__)    (___.__)__)         " << std::endl;
     }
 
     void show_bye() const {
-        std::cout << " .----------------.  .----------------.  .----------------.  .----------------. " << std::endl;
-        std::cout << "| .--------------. || .--------------. || .--------------. || .--------------. |" << std::endl;
-        std::cout << "| |   ______     | || |  ____  ____  | || |  _________   | || |              | |" << std::endl;
-        std::cout << "| |  |_   _ \\    | || | |_  _||_  _| | || | |_   ___  |  | || |      _       | |" << std::endl;
-        std::cout << "| |    | |_) |   | || |   \\ \\  / /   | || |   | |_  \\_|  | || |     | |      | |" << std::endl;
-        std::cout << "| |    |  __'.   | || |    \\ \\/ /    | || |   |  _|  _   | || |     | |      | |" << std::endl;
-        std::cout << "| |   _| |__) |  | || |    _|  |_    | || |  _| |___/ |  | || |     | |      | |" << std::endl;
-        std::cout << "| |  |_______/   | || |   |______|   | || | |_________|  | || |     |_|      | |" << std::endl;
-        std::cout << "| |              | || |              | || |              | || |     (_)      | |" << std::endl;
-        std::cout << "| '--------------' || '--------------' || '--------------' || '--------------' |" << std::endl;
-        std::cout << " '----------------'  '----------------'  '----------------'  '----------------' " << std::endl;
-        std::cout << "                               _.-=-._     .-, " << std::endl;
-        std::cout << "                             .' 0 )     \"-,.' / " << std::endl;
-        std::cout << "♥ ︎Was a joy working with you ︎(    )      _.  < " << std::endl;
-        std::cout << "                              `=._)___.=\'  `._\\" << std::endl;
+        console() << " .----------------.  .----------------.  .----------------.  .----------------. " << std::endl;
+        console() << "| .--------------. || .--------------. || .--------------. || .--------------. |" << std::endl;
+        console() << "| |   ______     | || |  ____  ____  | || |  _________   | || |              | |" << std::endl;
+        console() << "| |  |_   _ \\    | || | |_  _||_  _| | || | |_   ___  |  | || |      _       | |" << std::endl;
+        console() << "| |    | |_) |   | || |   \\ \\  / /   | || |   | |_  \\_|  | || |     | |      | |" << std::endl;
+        console() << "| |    |  __'.   | || |    \\ \\/ /    | || |   |  _|  _   | || |     | |      | |" << std::endl;
+        console() << "| |   _| |__) |  | || |    _|  |_    | || |  _| |___/ |  | || |     | |      | |" << std::endl;
+        console() << "| |  |_______/   | || |   |______|   | || | |_________|  | || |     |_|      | |" << std::endl;
+        console() << "| |              | || |              | || |              | || |     (_)      | |" << std::endl;
+        console() << "| '--------------' || '--------------' || '--------------' || '--------------' |" << std::endl;
+        console() << " '----------------'  '----------------'  '----------------'  '----------------' " << std::endl;
+        console() << "                               _.-=-._     .-, " << std::endl;
+        console() << "                             .' 0 )     \"-,.' / " << std::endl;
+        console() << "♥ ︎Was a joy working with you ︎(    )      _.  < " << std::endl;
+        console() << "                              `=._)___.=\'  `._\\" << std::endl;
     }
     
-    void show_version_tree_bubbles(tree_node* root, const std::string& prefix = "", bool is_last = true) const {
-        if (!root) return;
-    
-        std::string branch = is_last ? "└─ " : "├─ ";
-        std::string bubble_prefix = prefix + (is_last ? "    " : "│   ");
-    
-        std::cout << prefix << branch << "   /`````\\ " << std::endl;
-        std::cout << bubble_prefix << " |  V" << root->version_id << "   |" << std::endl;
-        std::cout << bubble_prefix << "  \\_____/ " << std::endl;
-    
-        if (!root->message.empty())
-            std::cout << bubble_prefix << "\"" << root->message << "\"" << std::endl;
-    
-        if (!root->children.empty()) {
-            std::cout << bubble_prefix << "   |" << std::endl;
-        }
-    
-        for (size_t i = 0; i < root->children.size(); ++i) {
-            show_version_tree_bubbles(root->children[i], prefix + (is_last ? "    " : "│   "), i == root->children.size() - 1);
-        }
+    void show_version_tree_bubbles(tree_node* root, int max_depth = -1) const {
+        render_tree(console(), root, max_depth, [](std::string& out, tree_node* node, const std::string& prefix, bool is_last, bool expanded) {
+            const char* pad = is_last ? "    " : "│   ";
+            out += prefix;
+            out += is_last ? "└─ " : "├─ ";
+            out += "   /`````\\ \n";
+            out += prefix;
+            out += pad;
+            out += " |  V";
+            out += std::to_string(node->version_id);
+            out += "   |\n";
+            out += prefix;
+            out += pad;
+            out += "  \\_____/ \n";
+            if (!node->message.empty()) {
+                out += prefix;
+                out += pad;
+                out += "\"";
+                out += node->message;
+                out += "\"\n";
+            }
+            if (node->first_child) {
+                out += prefix;
+                out += pad;
+                out += expanded ? "   |\n" : "   ...\n";
+            }
+        });
     }
 
 
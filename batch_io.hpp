@@ -0,0 +1,134 @@
+#ifndef BATCH_IO_HPP
+#define BATCH_IO_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <streambuf>
+#include <vector>
+
+// Line source for batch mode. Input is pulled in large blocks and handed out
+// as string_view slices of the block, so no line is copied on the way in.
+// A line that straddles two blocks is moved to the front before the next
+// read, and the block doubles if a single line outgrows it.
+class batch_in {
+    std::FILE* src;
+    std::vector<char> buf;
+    size_t begin;
+    size_t end;
+    bool eof;
+
+    bool refill();
+
+public:
+    explicit batch_in(std::FILE* src, size_t block = 1 << 20);
+
+    // Next line without its '\n' (or "\r\n"). The slice is only valid until
+    // the following call.
+    bool next(std::string_view& line);
+};
+
+// Output sink for batch mode. Everything written through it collects in one
+// large buffer that goes out only when full or when drained explicitly.
+// sync() is a no-op on purpose: std::endl lands there, and a flush per line
+// is what throttles bulk runs.
+class batch_out : public std::streambuf {
+    std::vector<char> buf;
+    std::FILE* dst;
+    long long written;
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override { return 0; }
+
+public:
+    explicit batch_out(std::FILE* dst, size_t cap = 1 << 22);
+    ~batch_out() override { drain(); }
+
+    bool drain();
+    long long bytes_written() const { return written + (pptr() - pbase()); }
+};
+
+// Implementation
+batch_in::batch_in(std::FILE* s, size_t block) : src(s), buf(block), begin(0), end(0), eof(false) {}
+
+bool batch_in::refill() {
+    if (eof) return false;
+    if (begin > 0) {
+        std::memmove(buf.data(), buf.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+    }
+    if (end == buf.size()) buf.resize(buf.size() * 2);
+    size_t got = std::fread(buf.data() + end, 1, buf.size() - end, src);
+    if (got == 0) eof = true;
+    end += got;
+    return got > 0;
+}
+
+bool batch_in::next(std::string_view& line) {
+    size_t scanned = begin;
+    for (;;) {
+        const char* p = buf.data();
+        const void* nl = std::memchr(p + scanned, '\n', end - scanned);
+        if (nl) {
+            size_t stop = static_cast<const char*>(nl) - p;
+            size_t len = stop - begin;
+            if (len > 0 && p[stop - 1] == '\r') --len;
+            line = std::string_view(p + begin, len);
+            begin = stop + 1;
+            return true;
+        }
+        size_t seen = end - begin;
+        if (!refill()) break;
+        scanned = begin + seen;
+    }
+    if (begin == end) return false;
+    size_t len = end - begin;
+    if (buf[end - 1] == '\r') --len;
+    line = std::string_view(buf.data() + begin, len);
+    begin = end;
+    return true;
+}
+
+batch_out::batch_out(std::FILE* d, size_t cap) : buf(cap), dst(d), written(0) {
+    setp(buf.data(), buf.data() + buf.size());
+}
+
+bool batch_out::drain() {
+    size_t n = pptr() - pbase();
+    bool ok = n == 0 || std::fwrite(pbase(), 1, n, dst) == n;
+    written += n;
+    setp(buf.data(), buf.data() + buf.size());
+    return ok && std::fflush(dst) == 0;
+}
+
+batch_out::int_type batch_out::overflow(int_type c) {
+    if (!drain()) return traits_type::eof();
+    if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
+
+// Short writes are copied into the buffer; one larger than the whole buffer
+// goes straight through after whatever is pending.
+std::streamsize batch_out::xsputn(const char* s, std::streamsize n) {
+    if (n <= epptr() - pptr()) {
+        std::memcpy(pptr(), s, n);
+        pbump(static_cast<int>(n));
+        return n;
+    }
+    if (!drain()) return 0;
+    if (static_cast<size_t>(n) >= buf.size()) {
+        size_t put = std::fwrite(s, 1, n, dst);
+        written += put;
+        return static_cast<std::streamsize>(put);
+    }
+    std::memcpy(pptr(), s, n);
+    pbump(static_cast<int>(n));
+    return n;
+}
+
+#endif // BATCH_IO_HPP
@@ -0,0 +1,803 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include "hash_map.hpp"
+#include "heap.hpp"
+#include "shard_map.hpp"
+#include "file.hpp"
+#include "file_system.hpp"
+#include "search_index.hpp"
+
+// Micro-benchmarks behind the --*-bench options. Each one runs a fixed
+// workload against one data structure, next to the simpler structure it
+// replaced where there is one, and prints its timings on stdout.
+
+// hash_map behind one mutex: the baseline a locked files_map would give.
+struct locked_map {
+    hash_map<std::string, int> m;
+    std::mutex mu;
+
+    void ins(const std::string& k, int v) {
+        std::lock_guard<std::mutex> hold(mu);
+        m.ins(k, v);
+    }
+    bool find(const std::string& k, int& v) {
+        std::lock_guard<std::mutex> hold(mu);
+        return m.find(k, v);
+    }
+    bool rm(const std::string& k) {
+        std::lock_guard<std::mutex> hold(mu);
+        return m.rm(k);
+    }
+    bool rename(const std::string& from, const std::string& to) {
+        std::lock_guard<std::mutex> hold(mu);
+        int v, taken;
+        if (!m.find(from, v) || m.find(to, taken)) return false;
+        m.rm(from);
+        m.ins(to, v);
+        return true;
+    }
+};
+
+// Runs ops operations split over threads: 90% lookups of shared keys that
+// are always present, 8% inserts and removals of the thread's own keys, and
+// 2% renames of the thread's own key back and forth. Returns the elapsed
+// seconds; a lookup that misses a shared key counts in misses.
+template <typename Map>
+double map_mix(Map& m, int threads, long long ops, const std::vector<std::string>& shared, long long& misses) {
+    for (size_t i = 0; i < shared.size(); ++i) m.ins(shared[i], static_cast<int>(i));
+    std::atomic<long long> missed{0};
+    auto body = [&](int t) {
+        std::vector<std::string> own;
+        for (int j = 0; j < 64; ++j) own.push_back("t" + std::to_string(t) + "_" + std::to_string(j));
+        std::string names[2] = {"t" + std::to_string(t) + "_a", "t" + std::to_string(t) + "_b"};
+        m.ins(names[0], t);
+        int at = 0;
+        std::uint64_t x = 0x9e3779b97f4a7c15ull * (t + 1);
+        long long miss = 0;
+        for (long long i = 0; i < ops / threads; ++i) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            int r = static_cast<int>(x % 100);
+            int v;
+            if (r < 90) miss += !m.find(shared[(x >> 8) % shared.size()], v);
+            else if (r < 94) m.ins(own[(x >> 8) % own.size()], t);
+            else if (r < 98) m.rm(own[(x >> 8) % own.size()]);
+            else if (m.rename(names[at], names[1 - at])) at = 1 - at;
+        }
+        missed += miss;
+    };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) pool.emplace_back(body, t);
+    for (std::thread& th : pool) th.join();
+    misses = missed;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// --map-bench <threads>: the read/write mix above on files_map's map type
+// and on the locked baseline.
+int run_map_bench(int threads) {
+    if (threads < 1) threads = 1;
+    const long long ops = 4000000;
+    std::vector<std::string> shared;
+    for (int i = 0; i < 10000; ++i) shared.push_back("file" + std::to_string(i));
+    std::cout << "[*]Map bench: " << threads << " threads, " << ops << " ops (90% find, 8% insert/remove, 2% rename) over "
+              << shared.size() << " shared keys" << std::endl;
+    long long misses;
+    {
+        shard_map<std::string, int> m;
+        double secs = map_mix(m, threads, ops, shared, misses);
+        std::cout << "[*]shard_map        : " << secs * 1000.0 << " ms (" << ops / secs / 1e6 << " Mops/s), "
+                  << misses << " misses" << std::endl;
+    }
+    {
+        locked_map m;
+        double secs = map_mix(m, threads, ops, shared, misses);
+        std::cout << "[*]hash_map + mutex : " << secs * 1000.0 << " ms (" << ops / secs / 1e6 << " Mops/s), "
+                  << misses << " misses" << std::endl;
+    }
+    std::cout << "[*]Reclaimed " << epoch_domain::global().collect() << " retired objects at exit." << std::endl;
+    return 0;
+}
+
+// True when text is records 0..n-1 as written by read_mix, judging by its
+// length, its middle record and its last one.
+bool whole_records(const std::string& text) {
+    const size_t rec = 8;
+    if (text.size() % rec) return false;
+    size_t n = text.size() / rec;
+    for (size_t k : {n / 2, n - 1}) {
+        if (n == 0) break;
+        if (std::strtoul(text.substr(k * rec, rec - 1).c_str(), nullptr, 10) != k || text[k * rec + rec - 1] != '\n')
+            return false;
+    }
+    return true;
+}
+
+// One writer appends records numbered 0..writes-1 ("0000042\n") to a file
+// and snapshots it every 64 records, while readers alternate between reading
+// the active version and pinning a random snapshot. With locked set every
+// call goes through one mutex instead of the lock-free read side. Reports
+// the writer's time, the number of reads and how many came back torn.
+double read_mix(int readers, int writes, bool locked, long long& reads, long long& torn) {
+    fl f("bench");
+    f.share(true);
+    std::mutex mu;
+    std::atomic<bool> done{false};
+    std::atomic<long long> read_cnt{0}, torn_cnt{0};
+    auto reader = [&](int r) {
+        std::uint64_t x = 0x9e3779b97f4a7c15ull * (r + 1);
+        long long n = 0, bad = 0;
+        std::string text;
+        rope pinned;
+        while (!done.load(std::memory_order_relaxed)) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            bool got;
+            if (x & 1) {
+                if (locked) {
+                    std::lock_guard<std::mutex> hold(mu);
+                    text = f.read();
+                    got = true;
+                } else got = f.read_shared(text);
+            } else {
+                int id = static_cast<int>((x >> 8) % (writes / 64 + 1));
+                if (locked) {
+                    std::lock_guard<std::mutex> hold(mu);
+                    got = f.pin(id, pinned);
+                } else got = f.pin(id, pinned);
+                if (got) text = pinned.read();
+            }
+            if (!got) continue;
+            ++n;
+            bad += !whole_records(text);
+        }
+        read_cnt += n;
+        torn_cnt += bad;
+    };
+    std::vector<std::thread> pool;
+    for (int r = 0; r < readers; ++r) pool.emplace_back(reader, r);
+
+    auto start = std::chrono::steady_clock::now();
+    char rec[16];
+    for (int i = 0; i < writes; ++i) {
+        std::snprintf(rec, sizeof(rec), "%07d\n", i);
+        if (locked) {
+            std::lock_guard<std::mutex> hold(mu);
+            f.ins(rec);
+            if (i % 64 == 63) f.ss("");
+        } else {
+            f.ins(rec);
+            if (i % 64 == 63) f.ss("");
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    done = true;
+    for (std::thread& th : pool) th.join();
+    reads = read_cnt;
+    torn = torn_cnt;
+    return secs;
+}
+
+// --read-bench <readers>: read_mix lock-free and behind one mutex.
+int run_read_bench(int readers) {
+    if (readers < 1) readers = 1;
+    const int writes = 20000;
+    std::cout << "[*]Read bench: 1 writer (" << writes << " INSERTs, SNAPSHOT every 64), " << readers
+              << " reader threads on the active version and pinned snapshots" << std::endl;
+    for (bool locked : {false, true}) {
+        long long reads, torn;
+        double secs = read_mix(readers, writes, locked, reads, torn);
+        std::cout << (locked ? "[*]one mutex : " : "[*]lock-free : ") << secs * 1000.0 << " ms of writing ("
+                  << static_cast<long long>(writes / secs) << " inserts/s), " << reads << " reads ("
+                  << static_cast<long long>(reads / secs) << " reads/s), " << torn << " torn" << std::endl;
+    }
+    return 0;
+}
+
+
+// The chained table hash_map replaced: one heap node per entry and a bucket
+// count that stops growing at 1009.
+template <typename K, typename V>
+class chained_map {
+    struct node {
+        K key;
+        V value;
+        node* next;
+    };
+
+    std::vector<node*> table;
+    int size = 0;
+    int cap_in = 0;
+    static constexpr int capacities[] = {7, 17, 37, 79, 163, 331, 673, 1009};
+
+    size_t slot(int key) const { return static_cast<size_t>(key) % table.size(); }
+    size_t slot(const std::string& key) const {
+        int h = 0;
+        for (char c : key) h = h * 131 + static_cast<unsigned char>(c);
+        return static_cast<size_t>(static_cast<unsigned>(h)) % table.size();
+    }
+
+public:
+    chained_map() : table(capacities[0], nullptr) {}
+    ~chained_map() {
+        for (node* n : table) {
+            while (n) {
+                node* next = n->next;
+                delete n;
+                n = next;
+            }
+        }
+    }
+    chained_map(const chained_map&) = delete;
+    chained_map& operator=(const chained_map&) = delete;
+
+    void ins(const K& key, const V& value) {
+        size_t i = slot(key);
+        for (node* n = table[i]; n; n = n->next) {
+            if (n->key == key) {
+                n->value = value;
+                return;
+            }
+        }
+        table[i] = new node{key, value, table[i]};
+        if (++size > 0.8 * table.size() && cap_in + 1 < static_cast<int>(sizeof(capacities) / sizeof(capacities[0]))) {
+            std::vector<node*> bigger(capacities[++cap_in], nullptr);
+            table.swap(bigger);
+            for (node* n : bigger) {
+                while (n) {
+                    node* next = n->next;
+                    size_t j = slot(n->key);
+                    n->next = table[j];
+                    table[j] = n;
+                    n = next;
+                }
+            }
+        }
+    }
+    bool find(const K& key, V& value_out) const {
+        for (node* n = table[slot(key)]; n; n = n->next) {
+            if (n->key == key) {
+                value_out = n->value;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// std::unordered_map behind the hash_map interface, as a reference point.
+template <typename K, typename V>
+struct std_map {
+    std::unordered_map<K, V> m;
+
+    void ins(const K& key, const V& value) { m[key] = value; }
+    bool find(const K& key, V& value_out) const {
+        auto it = m.find(key);
+        if (it == m.end()) return false;
+        value_out = it->second;
+        return true;
+    }
+};
+
+// Inserts every key of present into a fresh map, then looks each one up and
+// looks up every key of absent, in a shuffled order. Reports ns per
+// operation of each phase, the best of three rounds.
+template <typename Map, typename K>
+void map_ops(const char* label, const std::vector<K>& present, const std::vector<K>& absent) {
+    std::vector<size_t> order(present.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::uint64_t x = 0x9e3779b97f4a7c15ull;
+    for (size_t i = order.size(); i > 1; --i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        std::swap(order[i - 1], order[x % i]);
+    }
+    double best[3] = {1e30, 1e30, 1e30};
+    long long found = 0;
+    for (int round = 0; round < 3; ++round) {
+        Map m;
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < present.size(); ++i) m.ins(present[i], static_cast<int>(i));
+        auto t1 = std::chrono::steady_clock::now();
+        found = 0;
+        int v;
+        for (size_t i : order) found += m.find(present[i], v);
+        auto t2 = std::chrono::steady_clock::now();
+        for (size_t i : order) found += m.find(absent[i], v);
+        auto t3 = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point at[4] = {t0, t1, t2, t3};
+        for (int k = 0; k < 3; ++k)
+            best[k] = std::min(best[k], std::chrono::duration<double, std::nano>(at[k + 1] - at[k]).count() / present.size());
+    }
+    std::cout << "[*]" << label << ": insert " << best[0] << " ns, hit " << best[1] << " ns, miss " << best[2]
+              << " ns per op (" << found << " found)" << std::endl;
+}
+
+// --hash-bench <keys>: hash_map against the chained table it replaced and
+// against std::unordered_map, with file-name keys and with int keys.
+int run_hash_bench(int keys) {
+    if (keys < 1) keys = 1;
+    std::cout << "[*]Hash bench: " << keys << " keys inserted, then every key found and " << keys
+              << " absent keys missed" << std::endl;
+    std::vector<std::string> names, other;
+    std::vector<int> ids, other_ids;
+    for (int i = 0; i < keys; ++i) {
+        names.push_back("file" + std::to_string(i));
+        other.push_back("absent" + std::to_string(i));
+        ids.push_back(i * 7);
+        other_ids.push_back(i * 7 + 3);
+    }
+    map_ops<hash_map<std::string, int>>("string hash_map     ", names, other);
+    map_ops<chained_map<std::string, int>>("string chained_map  ", names, other);
+    map_ops<std_map<std::string, int>>("string unordered_map", names, other);
+    map_ops<hash_map<int, int>>("int    hash_map     ", ids, other_ids);
+    map_ops<chained_map<int, int>>("int    chained_map  ", ids, other_ids);
+    map_ops<std_map<int, int>>("int    unordered_map", ids, other_ids);
+    return 0;
+}
+
+// The name-keyed BIGGEST heap that heap replaced: every swap removes and
+// re-inserts both names in the position map.
+class name_heap {
+    std::vector<std::pair<std::string, int>> elements;
+    hash_map<std::string, int> key_to_idx;
+
+    void swap_els(int i, int j) {
+        key_to_idx.rm(elements[i].first);
+        key_to_idx.rm(elements[j].first);
+        std::swap(elements[i], elements[j]);
+        key_to_idx.ins(elements[i].first, i);
+        key_to_idx.ins(elements[j].first, j);
+    }
+    void heapify_up(int idx) {
+        while (idx > 0 && elements[idx].second > elements[(idx - 1) / 2].second) {
+            swap_els(idx, (idx - 1) / 2);
+            idx = (idx - 1) / 2;
+        }
+    }
+    void heapify_down(int idx) {
+        int n = static_cast<int>(elements.size());
+        for (;;) {
+            int largest = idx, l = 2 * idx + 1, r = 2 * idx + 2;
+            if (l < n && elements[l].second > elements[largest].second) largest = l;
+            if (r < n && elements[r].second > elements[largest].second) largest = r;
+            if (largest == idx) break;
+            swap_els(idx, largest);
+            idx = largest;
+        }
+    }
+
+public:
+    void ins(const std::string& key, int value) {
+        elements.push_back({key, value});
+        key_to_idx.ins(key, static_cast<int>(elements.size()) - 1);
+        heapify_up(static_cast<int>(elements.size()) - 1);
+    }
+    void upd(const std::string& key, int new_val) {
+        int idx;
+        if (!key_to_idx.find(key, idx)) return;
+        int old_val = elements[idx].second;
+        elements[idx].second = new_val;
+        if (new_val > old_val) heapify_up(idx);
+        else if (new_val < old_val) heapify_down(idx);
+    }
+    int max() const { return elements.empty() ? 0 : elements[0].second; }
+
+    // How BIGGEST used to answer: copy the whole heap, then pop num times.
+    std::vector<std::pair<std::string, int>> top_by_copy(int num) const {
+        std::vector<std::pair<std::string, int>> temp = elements, out;
+        int n = std::min(num, static_cast<int>(temp.size()));
+        for (int i = 0; i < n; ++i) {
+            out.push_back(temp[0]);
+            std::swap(temp[0], temp.back());
+            temp.pop_back();
+            int idx = 0, size = static_cast<int>(temp.size());
+            for (;;) {
+                int largest = idx, l = 2 * idx + 1, r = 2 * idx + 2;
+                if (l < size && temp[l].second > temp[largest].second) largest = l;
+                if (r < size && temp[r].second > temp[largest].second) largest = r;
+                if (largest == idx) break;
+                std::swap(temp[idx], temp[largest]);
+                idx = largest;
+            }
+        }
+        return out;
+    }
+};
+
+// --heap-bench <files>: 1M upd calls on a BIGGEST heap of that many files,
+// as INSERT/UPDATE/SNAPSHOT make them: a random file gains a version, and one
+// call in ten loses a few to pruning instead. Runs the same sequence on heap
+// and on name_heap. Then times BIGGEST 5 on 1M entries: heap::top against
+// name_heap's copy-and-pop.
+int run_heap_bench(int files) {
+    if (files < 1) files = 1;
+    const int updates = 1000000;
+    std::vector<int> file_of(updates), value_of(updates);
+    std::vector<int> versions(files, 1);
+    std::uint64_t x = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < updates; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        int f = static_cast<int>((x >> 8) % files);
+        if (x % 10 == 0) versions[f] = std::max(1, versions[f] - static_cast<int>((x >> 40) % 8));
+        else ++versions[f];
+        file_of[i] = f;
+        value_of[i] = versions[f];
+    }
+    std::vector<std::string> names;
+    for (int f = 0; f < files; ++f) names.push_back("file" + std::to_string(f));
+    std::cout << "[*]Heap bench: " << updates << " upd calls over " << files << " files" << std::endl;
+
+    hp h;
+    for (int f = 0; f < files; ++f) h.ins(f, 1);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < updates; ++i) h.upd(file_of[i], value_of[i]);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[*]heap (handles)    : " << secs * 1000.0 << " ms (" << secs * 1e9 / updates << " ns per upd), max "
+              << h.top(1)[0].second << std::endl;
+
+    name_heap nh;
+    for (int f = 0; f < files; ++f) nh.ins(names[f], 1);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < updates; ++i) nh.upd(names[file_of[i]], value_of[i]);
+    secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[*]name_heap (names) : " << secs * 1000.0 << " ms (" << secs * 1e9 / updates << " ns per upd), max "
+              << nh.max() << std::endl;
+
+    const int entries = 1000000, k = 5;
+    hp big;
+    name_heap big_names;
+    for (int i = 0; i < entries; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        int v = static_cast<int>((x >> 8) % 1000000);
+        big.ins(i, v);
+        big_names.ins("file" + std::to_string(i), v);
+    }
+    const int reps = 20;
+    long long sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r) sum += big.top(k)[k - 1].second;
+    double top_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / reps;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r) sum -= big_names.top_by_copy(k)[k - 1].second;
+    double copy_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / reps;
+    std::cout << "[*]BIGGEST " << k << " of " << entries << " : top " << top_us << " us, copy and pop " << copy_us
+              << " us" << (sum == 0 ? "" : " (answers differ)") << std::endl;
+    return 0;
+}
+
+// --rollback-bench <depth>: ROLLBACK latency on a linear chain of versions
+// as it grows to depth, measured at every power of ten from 1000. Each round
+// rolls back to a random ancestor of the tip and switches back to the tip;
+// the parent walk the jump pointers replaced is timed on the same targets
+// (on fewer of them on deep chains, where each walk takes milliseconds).
+// Version ids are ints, so depth stops at 10^9.
+int run_rollback_bench(int max_depth) {
+    const int deepest = 1000000000;
+    if (max_depth < 1000) max_depth = 1000;
+    if (max_depth > deepest) max_depth = deepest;
+    const int rounds = 10000;
+    std::cout << "[*]Rollback bench: linear chain up to " << max_depth << " versions, " << rounds
+              << " ROLLBACKs to random ancestors per depth" << std::endl;
+    fl f("bench");
+    int tip = 0;
+    std::uint64_t x = 0x9e3779b97f4a7c15ull;
+    for (long long depth = 1000; depth <= max_depth; depth *= 10) {
+        // The root is a snapshot, so every UPDATE adds one version.
+        for (; tip < depth; ++tip) {
+            f.upd("x");
+            f.ss("");
+        }
+        tree_node* top = f.find_ver(tip);
+        std::vector<int> target(rounds);
+        for (int& t : target) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            t = static_cast<int>(x % tip);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int t : target) {
+            f.rb(t);
+            f.switch_version(tip);
+        }
+        double rb_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+        std::vector<tree_node*> node(std::max(10, static_cast<int>(rounds / (depth / 1000))));
+        for (size_t i = 0; i < node.size(); ++i) node[i] = f.find_ver(target[i]);
+        long long found = 0;
+        start = std::chrono::steady_clock::now();
+        for (tree_node* anc : node) {
+            tree_node* cur = top;
+            while (cur && cur != anc) cur = cur->parent;
+            found += cur != nullptr;
+        }
+        double walk_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / node.size();
+        std::cout << "[*]depth " << tip << " : ROLLBACK + SWITCH " << rb_ns << " ns, parent walk " << walk_ns
+                  << " ns per ancestor check (" << found << " of " << node.size() << " found)" << std::endl;
+    }
+    return 0;
+}
+
+// --pool-bench <versions>: create and drop a file with that many versions,
+// then the same linear chain of bare nodes from a node_pool against one
+// new/delete per node, with the number of heap allocations each side makes.
+int run_pool_bench(int versions) {
+    if (versions < 1000) versions = 1000;
+    std::cout << "[*]Pool bench: " << versions << " versions in a linear chain" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    fl* f = new fl("bench");
+    // The root is a snapshot, so every UPDATE adds one version.
+    for (int i = 1; i < versions; ++i) {
+        f->upd("x");
+        f->ss("");
+    }
+    double create_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    storage_stats st;
+    f->collect_stats(st);
+    start = std::chrono::steady_clock::now();
+    delete f;
+    double drop_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[*]file : create " << fmt_ms(create_ms) << " ms, drop " << fmt_ms(drop_ms) << " ms, "
+              << st.pool_chunks << " pool chunks for " << st.versions << " nodes" << std::endl;
+
+    const rope text("x");
+    start = std::chrono::steady_clock::now();
+    std::vector<tree_node*> node(versions);
+    size_t allocs = 0;
+    {
+        node_pool<tree_node> pool;
+        node[0] = pool.make(0, "");
+        for (int i = 1; i < versions; ++i) {
+            node[i] = pool.make(i, text, node[i - 1]);
+            node[i - 1]->add_child(node[i]);
+        }
+        for (tree_node* n : node) pool.destroy(n);
+        allocs = pool.alloc_cnt();
+    }
+    double pool_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    node[0] = new tree_node(0, "");
+    for (int i = 1; i < versions; ++i) {
+        node[i] = new tree_node(i, text, node[i - 1]);
+        node[i - 1]->add_child(node[i]);
+    }
+    for (tree_node* n : node) delete n;
+    double new_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "[*]node_pool : " << fmt_ms(pool_ms) << " ms, " << allocs << " allocations" << std::endl;
+    std::cout << "[*]new/delete : " << fmt_ms(new_ms) << " ms, " << versions << " allocations" << std::endl;
+    return 0;
+}
+
+// A document of words of about 8 bytes each, and the offset of every word.
+std::string bench_doc(size_t bytes, std::vector<size_t>& word_at) {
+    std::string doc;
+    doc.reserve(bytes + 16);
+    char buf[16];
+    word_at.clear();
+    for (unsigned i = 0; doc.size() < bytes; ++i) {
+        word_at.push_back(doc.size());
+        int n = std::snprintf(buf, sizeof(buf), "w%06u ", i % 1000000);
+        doc.append(buf, n);
+    }
+    return doc;
+}
+
+// Replaces the first letter of each chosen word, so edits never merge into
+// their neighbours.
+std::string bench_edit(const std::string& doc, const std::vector<size_t>& word_at, size_t first, size_t step) {
+    std::string out = doc;
+    for (size_t w = first; w < word_at.size(); w += step) out[word_at[w]] = 'E';
+    return out;
+}
+
+// --diff-bench <max_bytes>: DIFF of a document against a copy with one word
+// in every 1000 changed, at sizes growing tenfold from 10k bytes.
+int run_diff_bench(int max_bytes) {
+    if (max_bytes < 10000) max_bytes = 10000;
+    const size_t step = 1000;
+    std::cout << "[*]Diff bench: documents up to " << max_bytes << " bytes, one word in " << step << " edited"
+              << std::endl;
+    for (long long bytes = 10000; bytes <= max_bytes; bytes *= 10) {
+        std::vector<size_t> word_at;
+        std::string a = bench_doc(bytes, word_at);
+        std::string b = bench_edit(a, word_at, step / 2, step);
+        int rounds = static_cast<int>(std::max(1LL, 10000000 / bytes));
+        size_t hunks = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            text_diff d(a, b);
+            hunks = d.hunks().size();
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / rounds;
+        std::cout << "[*]" << a.size() << " bytes, " << word_at.size() << " words, " << hunks << " hunks : "
+                  << fmt_ms(ms) << " ms, " << ms * 1e6 / a.size() << " ns per byte" << std::endl;
+    }
+    return 0;
+}
+
+// --merge-bench <max_bytes>: MERGE of two sides that each edit one word in
+// every 1000, at different words, at sizes growing tenfold from 10k bytes.
+// The time per byte stays flat if the merge is linear in the document.
+int run_merge_bench(int max_bytes) {
+    if (max_bytes < 10000) max_bytes = 10000;
+    const size_t step = 1000;
+    std::cout << "[*]Merge bench: documents up to " << max_bytes << " bytes, each side edits one word in " << step
+              << std::endl;
+    for (long long bytes = 10000; bytes <= max_bytes; bytes *= 10) {
+        std::vector<size_t> word_at;
+        std::string base = bench_doc(bytes, word_at);
+        std::string ours = bench_edit(base, word_at, step / 4, step);
+        std::string theirs = bench_edit(base, word_at, step * 3 / 4, step);
+        int rounds = static_cast<int>(std::max(1LL, 10000000 / bytes));
+        int applied = 0;
+        size_t clashes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            text_merge m(base, ours, theirs);
+            applied = m.applied();
+            clashes = m.conflicts().size();
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / rounds;
+        std::cout << "[*]" << base.size() << " bytes, " << applied << " changes applied, " << clashes
+                  << " conflicts : " << fmt_ms(ms) << " ms, " << ms * 1e6 / base.size() << " ns per byte" << std::endl;
+    }
+    return 0;
+}
+
+// --search-bench <versions>: indexes that many versions, 1000 per file, of
+// 20 words each drawn from 10000, then times SEARCH for single words through
+// the trigram index (candidates plus the check against each text) next to
+// scanning every text.
+int run_search_bench(int versions) {
+    if (versions < 1000) versions = 1000;
+    const int per_file = 1000;
+    const int queries = 200;
+    std::cout << "[*]Search bench: " << versions << " versions, " << queries << " single-word SEARCHes"
+              << std::endl;
+    std::uint64_t x = 0x9e3779b97f4a7c15ull;
+    auto next = [&x]() {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x;
+    };
+    char buf[16];
+    std::vector<std::string> text(versions);
+    std::vector<std::uint64_t> id(versions);
+    size_t text_bytes = 0;
+    for (int v = 0; v < versions; ++v) {
+        for (int w = 0; w < 20; ++w) {
+            int n = std::snprintf(buf, sizeof(buf), "w%04u ", static_cast<unsigned>(next() % 10000));
+            text[v].append(buf, n);
+        }
+        id[v] = trigram_index::doc_id(v / per_file, v % per_file);
+        text_bytes += text[v].size();
+    }
+
+    trigram_index idx;
+    auto start = std::chrono::steady_clock::now();
+    for (int v = 0; v < versions; ++v) idx.add(id[v], text[v]);
+    double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[*]index : " << fmt_ms(build_ms) << " ms to build, " << idx.trigram_cnt() << " trigrams, "
+              << idx.posting_cnt() << " postings in " << idx.bytes() << " bytes ("
+              << static_cast<double>(idx.bytes()) / idx.posting_cnt() << " per posting) over " << text_bytes
+              << " bytes of text" << std::endl;
+
+    std::vector<std::string> pattern(queries);
+    for (std::string& p : pattern) {
+        std::snprintf(buf, sizeof(buf), "w%04u ", static_cast<unsigned>(next() % 10000));
+        p = buf;
+    }
+    std::unordered_map<std::uint64_t, int> version_of;
+    for (int v = 0; v < versions; ++v) version_of[id[v]] = v;
+
+    long long hits = 0, checked = 0;
+    std::vector<std::uint64_t> cand;
+    start = std::chrono::steady_clock::now();
+    for (const std::string& p : pattern) {
+        idx.candidates(p, cand);
+        checked += cand.size();
+        for (std::uint64_t c : cand) hits += text[version_of[c]].find(p) != std::string::npos;
+    }
+    double idx_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / queries;
+
+    long long scan_hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (const std::string& p : pattern) {
+        for (const std::string& t : text) scan_hits += t.find(p) != std::string::npos;
+    }
+    double scan_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / queries;
+
+    std::cout << "[*]trigram index : " << idx_us << " us per SEARCH, " << checked / queries << " candidates and "
+              << hits / queries << " hits per SEARCH" << std::endl;
+    std::cout << "[*]full scan : " << scan_us << " us per SEARCH, " << scan_hits / queries << " hits per SEARCH"
+              << std::endl;
+    return 0;
+}
+
+// --ckpt-bench <files>: checkpoints that many files of 100 versions each,
+// evicts the checkpoint from the page cache, and times loading it into an
+// empty file system (mapping and checking it, then registering every file)
+// and then reading every file, which builds its version tree.
+int run_ckpt_bench(int files) {
+    if (files < 1) files = 1;
+    const int versions = 100;
+    const std::string path = "ckpt_bench.ckpt";
+    std::cout << "[*]Checkpoint bench: " << files << " files of " << versions << " versions" << std::endl;
+    std::ostream quiet(nullptr);
+    console_stream() = &quiet;
+
+    std::vector<std::string> name(files);
+    double save_ms = 0;
+    {
+        file_system fs;
+        char buf[32];
+        for (int i = 0; i < files; ++i) {
+            std::snprintf(buf, sizeof(buf), "f%d", i);
+            name[i] = fs.create_file(buf);
+            // The root is a snapshot, so every UPDATE adds one version.
+            for (int v = 1; v < versions; ++v) {
+                std::snprintf(buf, sizeof(buf), "text %d of %d", v, i);
+                fs.update_file(name[i], buf);
+                fs.snapshot_file(name[i], "");
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        fs.save_checkpoint(path);
+        save_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        console_stream() = nullptr;
+        std::cout << "[*]Could not write '" << path << "'." << std::endl;
+        if (fd >= 0) ::close(fd);
+        return 1;
+    }
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+
+    file_system fs;
+    auto start = std::chrono::steady_clock::now();
+    fs.load_checkpoint(path);
+    double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    for (const std::string& n : name) fs.read_file(n);
+    double read_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    console_stream() = nullptr;
+    std::remove(path.c_str());
+
+    std::cout << "[*]save : " << fmt_ms(save_ms) << " ms, " << st.st_size << " bytes" << std::endl;
+    std::cout << "[*]load : " << fmt_ms(load_ms) << " ms, first READ of every file " << fmt_ms(read_ms) << " ms"
+              << std::endl;
+    return 0;
+}
+
+#endif // BENCH_HPP
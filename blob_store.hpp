@@ -0,0 +1,132 @@
+#ifndef BLOB_STORE_HPP
+#define BLOB_STORE_HPP
+
+#include <string>
+#include <cstdint>
+#include <mutex>
+#include "hash_map.hpp"
+#include "hash.hpp"
+#include "rope.hpp"
+
+// Content-addressed store shared by every file. Snapshotted text is interned
+// here by its 64-bit hash, so identical versions (a template UPDATEd into
+// many files, a rollback followed by the same edit, ...) are kept once.
+// Blobs are shared across files, so the table and the reference counts are
+// guarded by a mutex, and a blob's rope is sealed: nothing ever appends to
+// its buffers again, which makes them safe to read from any thread.
+class blob_store {
+public:
+    struct blob {
+        rope data;
+        std::uint64_t key;
+        size_t size;
+        int refs;
+        bool interned;
+    };
+
+    static blob_store& global();
+
+    blob* acquire(const rope& text);
+    void retain(blob* b) {
+        std::lock_guard<std::mutex> hold(mu);
+        b->refs++;
+        log_bytes += b->size;
+    }
+    void release(blob* b);
+
+    long long unique_bytes() const { return uniq_bytes; }
+    long long logical_bytes() const { return log_bytes; }
+    long long blob_cnt() const { return blobs_cnt; }
+    double dedup_ratio() const { return uniq_bytes ? double(log_bytes) / uniq_bytes : 1.0; }
+    long long bytes_saved() const { return log_bytes - uniq_bytes; }
+
+private:
+    blob_store() {}
+    ~blob_store();
+
+    std::mutex mu;
+    hash_map<std::uint64_t, blob*> blobs;
+    long long uniq_bytes = 0;
+    long long log_bytes = 0;
+    long long blobs_cnt = 0;
+};
+
+// Counted reference to a blob; the blob is dropped from the store once the
+// last version referencing it goes away.
+class blob_ref {
+    blob_store::blob* b;
+
+public:
+    blob_ref() : b(nullptr) {}
+    explicit blob_ref(const rope& text) : b(blob_store::global().acquire(text)) {}
+    blob_ref(const blob_ref& other) : b(other.b) { if (b) blob_store::global().retain(b); }
+    blob_ref& operator=(const blob_ref& other);
+    ~blob_ref() { reset(); }
+
+    void reset();
+    explicit operator bool() const { return b != nullptr; }
+    const void* id() const { return b; }
+    const rope& data() const { return b->data; }
+    std::string read() const { return b->data.read(); }
+    size_t size() const { return b ? b->size : 0; }
+    size_t bytes() const { return b ? b->data.bytes() / b->refs : 0; }
+};
+
+// Implementation
+blob_store& blob_store::global() {
+    static blob_store store;
+    return store;
+}
+
+blob_store::~blob_store() {
+    blobs.iterate([](const std::uint64_t&, blob*& b) { delete b; });
+}
+
+blob_store::blob* blob_store::acquire(const rope& text) {
+    std::string flat = text.read();
+    std::uint64_t key = hash_bytes(flat);
+    rope sealed = text;
+    sealed.seal();
+    std::lock_guard<std::mutex> hold(mu);
+    blob* b = nullptr;
+    log_bytes += flat.size();
+    if (blobs.find(key, b)) {
+        if (b->size == flat.size() && b->data.read() == flat) {
+            b->refs++;
+            return b;
+        }
+        // 64-bit collision with different text: keep it, just don't share it.
+        uniq_bytes += flat.size();
+        blobs_cnt++;
+        return new blob{sealed, key, flat.size(), 1, false};
+    }
+    b = new blob{sealed, key, flat.size(), 1, true};
+    blobs.ins(key, b);
+    uniq_bytes += flat.size();
+    blobs_cnt++;
+    return b;
+}
+
+void blob_store::release(blob* b) {
+    std::lock_guard<std::mutex> hold(mu);
+    log_bytes -= b->size;
+    if (--b->refs > 0) return;
+    if (b->interned) blobs.rm(b->key);
+    uniq_bytes -= b->size;
+    blobs_cnt--;
+    delete b;
+}
+
+blob_ref& blob_ref::operator=(const blob_ref& other) {
+    if (other.b) blob_store::global().retain(other.b);
+    reset();
+    b = other.b;
+    return *this;
+}
+
+void blob_ref::reset() {
+    if (b) blob_store::global().release(b);
+    b = nullptr;
+}
+
+#endif // BLOB_STORE_HPP
@@ -0,0 +1,245 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hash_map.hpp"
+#include "rope.hpp"
+
+// On-disk checkpoint layout, designed to be used straight from an mmap:
+//   ckpt_header | ckpt_file[file_cnt] | ckpt_node[node_cnt] | string pool
+// Every file's nodes are contiguous and in preorder, so a parent always has a
+// smaller local index than its children. Offsets into the pool are relative
+// to pool_off. Identical blobs are written to the pool once. jrn_records and
+// jrn_sum mark how far into the journal the checkpoint reaches (see
+// journal.hpp); both are 0 when it was taken without one.
+
+struct ckpt_header {
+    char magic[8];
+    std::uint64_t file_cnt;
+    std::uint64_t node_cnt;
+    std::uint64_t files_off;
+    std::uint64_t nodes_off;
+    std::uint64_t pool_off;
+    std::uint64_t pool_len;
+    std::int32_t untitled_cnt;
+    std::int32_t kf_every;
+    std::int64_t jrn_records;
+    std::uint64_t jrn_sum;
+};
+
+struct ckpt_file {
+    std::uint64_t name_off;
+    std::uint64_t node_begin;
+    std::uint32_t name_len;
+    std::uint32_t node_cnt;
+    std::int32_t active;
+    std::int32_t total_versions;
+    std::int32_t kf_every;
+    std::int32_t pad;
+};
+
+enum ckpt_kind : std::uint8_t { CK_LIVE = 0, CK_BLOB = 1, CK_DELTA = 2 };
+
+struct ckpt_node {
+    std::int32_t version_id;
+    std::int32_t parent;
+    std::int64_t created_ts;
+    std::int64_t last_mod_ts;
+    std::int64_t ss_ts;
+    std::uint64_t msg_off;
+    std::uint64_t text_off;
+    std::uint64_t text_len;
+    std::uint64_t d_pre;
+    std::uint64_t d_suf;
+    std::uint32_t msg_len;
+    std::int32_t kf_dist;
+    std::uint8_t kind;
+    std::uint8_t pad[7];
+};
+
+const char ckpt_magic[8] = {'F', 'V', 'S', 'C', 'K', 'P', 'T', '2'};
+
+// Version ids past this would overflow the doubling of fl's snapshot table.
+const std::int32_t ckpt_max_versions = 1 << 30;
+
+// Read-only mapping of a checkpoint. Pages are only faulted in when a file
+// that lives on them is first used.
+class ckpt_map {
+    const char* base;
+    size_t len;
+
+    ckpt_map(const char* b, size_t l) : base(b), len(l) {}
+    bool valid() const;
+
+public:
+    ~ckpt_map() { ::munmap(const_cast<char*>(base), len); }
+
+    static std::shared_ptr<ckpt_map> open(const std::string& path);
+
+    const ckpt_header& header() const { return *reinterpret_cast<const ckpt_header*>(base); }
+    const ckpt_file& file_at(size_t i) const {
+        return reinterpret_cast<const ckpt_file*>(base + header().files_off)[i];
+    }
+    const ckpt_node& node_at(size_t i) const {
+        return reinterpret_cast<const ckpt_node*>(base + header().nodes_off)[i];
+    }
+    std::string str(std::uint64_t off, std::uint64_t n) const {
+        return std::string(base + header().pool_off + off, n);
+    }
+};
+
+// Accumulates a checkpoint in memory and writes it out in one pass.
+class ckpt_writer {
+    std::vector<ckpt_file> files;
+    std::vector<ckpt_node> nodes;
+    std::string pool;
+    hash_map<std::uint64_t, std::uint64_t> blob_offs;
+
+public:
+    std::uint64_t add_str(const std::string& s);
+    std::uint64_t add_blob(const void* id, const rope& text);
+    void add_file(const ckpt_file& f) { files.push_back(f); }
+    void add_node(const ckpt_node& n) { nodes.push_back(n); }
+    size_t node_cnt() const { return nodes.size(); }
+    size_t file_cnt() const { return files.size(); }
+
+    long long write(const std::string& path, int untitled_cnt, int kf_every,
+                    long long jrn_records = 0, std::uint64_t jrn_sum = 0) const;
+};
+
+// Implementation
+std::shared_ptr<ckpt_map> ckpt_map::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(ckpt_header))) {
+        ::close(fd);
+        return nullptr;
+    }
+    size_t len = static_cast<size_t>(st.st_size);
+    void* p = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return nullptr;
+
+    std::shared_ptr<ckpt_map> m(new ckpt_map(static_cast<const char*>(p), len));
+    return m->valid() ? m : nullptr;
+}
+
+// Each range is checked as off <= limit && n <= limit - off, so no sum or
+// product of untrusted fields can wrap around.
+bool ckpt_fits(std::uint64_t off, std::uint64_t cnt, std::uint64_t size, std::uint64_t limit) {
+    return off <= limit && cnt <= (limit - off) / size;
+}
+
+// Checks everything fl::fault_in and file_system::load_checkpoint rely on:
+// the tables and every string lie inside the file, each file's nodes lie
+// inside the node table with the root first and every parent before its
+// children, and each delta keeps no more of its parent than the parent has.
+bool ckpt_map::valid() const {
+    const ckpt_header& h = header();
+    if (std::memcmp(h.magic, ckpt_magic, 8) != 0) return false;
+    if (h.files_off % alignof(ckpt_file) != 0 || h.nodes_off % alignof(ckpt_node) != 0) return false;
+    if (!ckpt_fits(h.files_off, h.file_cnt, sizeof(ckpt_file), len)
+        || !ckpt_fits(h.nodes_off, h.node_cnt, sizeof(ckpt_node), len)
+        || !ckpt_fits(h.pool_off, h.pool_len, 1, len)) return false;
+
+    std::vector<std::uint64_t> text_len;
+    for (size_t i = 0; i < h.file_cnt; ++i) {
+        const ckpt_file& cf = file_at(i);
+        if (!ckpt_fits(cf.name_off, cf.name_len, 1, h.pool_len)) return false;
+        if (cf.node_cnt == 0 || !ckpt_fits(cf.node_begin, cf.node_cnt, 1, h.node_cnt)) return false;
+        if (cf.active < -1 || cf.active >= static_cast<std::int64_t>(cf.node_cnt)) return false;
+        if (cf.total_versions < 1 || cf.total_versions > ckpt_max_versions) return false;
+        text_len.assign(cf.node_cnt, 0);
+        for (size_t j = 0; j < cf.node_cnt; ++j) {
+            const ckpt_node& cn = node_at(cf.node_begin + j);
+            if (cn.version_id < 0 || cn.version_id >= cf.total_versions) return false;
+            if (j == 0 ? cn.parent != -1 : (cn.parent < 0 || static_cast<size_t>(cn.parent) >= j)) return false;
+            if (!ckpt_fits(cn.msg_off, cn.msg_len, 1, h.pool_len)
+                || !ckpt_fits(cn.text_off, cn.text_len, 1, h.pool_len)) return false;
+            if (cn.kind == CK_LIVE || cn.kind == CK_BLOB) {
+                text_len[j] = cn.text_len;
+            } else if (cn.kind == CK_DELTA && j > 0) {
+                std::uint64_t from = text_len[cn.parent];
+                if (cn.d_pre > from || cn.d_suf > from - cn.d_pre) return false;
+                text_len[j] = cn.d_pre + cn.d_suf + cn.text_len;
+            } else {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::uint64_t ckpt_writer::add_str(const std::string& s) {
+    std::uint64_t off = pool.size();
+    pool.append(s);
+    return off;
+}
+
+std::uint64_t ckpt_writer::add_blob(const void* id, const rope& text) {
+    std::uint64_t key = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(id));
+    std::uint64_t off = 0;
+    if (blob_offs.find(key, off)) return off;
+    off = add_str(text.read());
+    blob_offs.ins(key, off);
+    return off;
+}
+
+bool ckpt_sync(const std::string& path, int flags) {
+    int fd = ::open(path.c_str(), flags);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    return ::close(fd) == 0 && ok;
+}
+
+// Writes to a temporary file and renames it over path, so a crash never
+// leaves a half-written checkpoint behind. Returns the size, or -1.
+long long ckpt_writer::write(const std::string& path, int untitled_cnt, int kf_every,
+                             long long jrn_records, std::uint64_t jrn_sum) const {
+    ckpt_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, ckpt_magic, 8);
+    h.file_cnt = files.size();
+    h.node_cnt = nodes.size();
+    h.files_off = sizeof(ckpt_header);
+    h.nodes_off = h.files_off + files.size() * sizeof(ckpt_file);
+    h.pool_off = h.nodes_off + nodes.size() * sizeof(ckpt_node);
+    h.pool_len = pool.size();
+    h.untitled_cnt = untitled_cnt;
+    h.kf_every = kf_every;
+    h.jrn_records = jrn_records;
+    h.jrn_sum = jrn_sum;
+
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return -1;
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(files.data()), files.size() * sizeof(ckpt_file));
+        out.write(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(ckpt_node));
+        out.write(pool.data(), pool.size());
+        out.close();
+        if (!out) return -1;
+    }
+    // The data must be on disk before the rename makes it the checkpoint,
+    // and the rename itself before the caller relies on it.
+    if (!ckpt_sync(tmp, O_RDONLY)) return -1;
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) return -1;
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    if (!ckpt_sync(dir, O_RDONLY | O_DIRECTORY)) return -1;
+    return static_cast<long long>(h.pool_off + h.pool_len);
+}
+
+#endif // CHECKPOINT_HPP
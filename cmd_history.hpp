@@ -0,0 +1,212 @@
+#ifndef CMD_HISTORY_HPP
+#define CMD_HISTORY_HPP
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <algorithm>
+
+// Command log with bounded memory. The newest commands sit in a ring buffer;
+// when it runs out of entries or bytes, its older half is LZ-compressed into
+// a segment appended to an anonymous spill file, and only the segment's
+// offset and sizes stay in memory. Reads stream newest first and decompress
+// only the segments they actually reach.
+class cmd_history {
+    struct segment {
+        long offset;
+        std::uint32_t packed_len;
+        std::uint32_t raw_len;
+        int count;
+    };
+
+    std::vector<std::string> ring;
+    int first;
+    int count;
+    size_t ring_bytes;
+    size_t max_bytes;
+    std::vector<segment> segments;
+    long long spilled;
+    std::FILE* spill;
+
+    void spill_oldest(int n);
+    std::vector<std::string> load_segment(const segment& seg) const;
+
+    static void put_varint(std::string& out, std::uint32_t v);
+    static std::uint32_t get_varint(const std::string& in, size_t& pos);
+    static std::string lz_pack(const std::string& in);
+    static std::string lz_unpack(const std::string& in, size_t raw_len);
+
+public:
+    explicit cmd_history(int max_entries = 4096, size_t max_bytes = 1 << 20);
+    ~cmd_history();
+
+    void push(std::string_view cmd);
+    long long size() const { return spilled + count; }
+
+    // Calls func(cmd) for up to limit commands (all when limit < 0), newest
+    // first, after skipping the offset newest ones.
+    template <typename Func>
+    void visit(long long limit, long long offset, Func func) const;
+};
+
+// Implementation
+cmd_history::cmd_history(int max_entries, size_t max_b)
+    : ring(max_entries > 1 ? max_entries : 2), first(0), count(0), ring_bytes(0),
+      max_bytes(max_b), spilled(0), spill(std::tmpfile()) {}
+
+cmd_history::~cmd_history() {
+    if (spill) std::fclose(spill);
+}
+
+void cmd_history::push(std::string_view cmd) {
+    int cap = static_cast<int>(ring.size());
+    if (count == cap || (ring_bytes + cmd.size() > max_bytes && count > 1)) spill_oldest((count + 1) / 2);
+    int slot = (first + count) % cap;
+    ring[slot] = cmd;
+    ring_bytes += cmd.size();
+    ++count;
+}
+
+void cmd_history::spill_oldest(int n) {
+    std::string raw;
+    int cap = static_cast<int>(ring.size());
+    for (int i = 0; i < n; ++i) {
+        std::string& s = ring[(first + i) % cap];
+        put_varint(raw, static_cast<std::uint32_t>(s.size()));
+        raw.append(s);
+        ring_bytes -= s.size();
+        std::string().swap(s);
+    }
+    first = (first + n) % cap;
+    count -= n;
+
+    // Without a spill file the oldest commands are simply dropped.
+    if (!spill || std::fseek(spill, 0, SEEK_END) != 0) return;
+    std::string packed = lz_pack(raw);
+    segment seg{std::ftell(spill), static_cast<std::uint32_t>(packed.size()),
+                static_cast<std::uint32_t>(raw.size()), n};
+    if (std::fwrite(packed.data(), 1, packed.size(), spill) != packed.size()) return;
+    segments.push_back(seg);
+    spilled += n;
+}
+
+std::vector<std::string> cmd_history::load_segment(const segment& seg) const {
+    std::vector<std::string> out;
+    std::string packed(seg.packed_len, '\0');
+    if (std::fseek(spill, seg.offset, SEEK_SET) != 0
+        || std::fread(&packed[0], 1, packed.size(), spill) != packed.size()) return out;
+    std::string raw = lz_unpack(packed, seg.raw_len);
+    size_t pos = 0;
+    out.reserve(seg.count);
+    while (pos < raw.size()) {
+        std::uint32_t len = get_varint(raw, pos);
+        out.push_back(raw.substr(pos, len));
+        pos += len;
+    }
+    return out;
+}
+
+template <typename Func>
+void cmd_history::visit(long long limit, long long offset, Func func) const {
+    int cap = static_cast<int>(ring.size());
+    for (int i = count - 1; i >= 0 && limit != 0; --i) {
+        if (offset > 0) { --offset; continue; }
+        func(ring[(first + i) % cap]);
+        if (limit > 0) --limit;
+    }
+    for (auto it = segments.rbegin(); it != segments.rend() && limit != 0; ++it) {
+        if (offset >= it->count) { offset -= it->count; continue; }
+        std::vector<std::string> cmds = load_segment(*it);
+        for (int i = static_cast<int>(cmds.size()) - 1; i >= 0 && limit != 0; --i) {
+            if (offset > 0) { --offset; continue; }
+            func(cmds[i]);
+            if (limit > 0) --limit;
+        }
+    }
+}
+
+void cmd_history::put_varint(std::string& out, std::uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+std::uint32_t cmd_history::get_varint(const std::string& in, size_t& pos) {
+    std::uint32_t v = 0;
+    for (int shift = 0; pos < in.size(); shift += 7) {
+        unsigned char b = static_cast<unsigned char>(in[pos++]);
+        v |= std::uint32_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+    }
+    return v;
+}
+
+// Byte-oriented LZ77. A control byte c < 0x80 introduces c + 1 literal
+// bytes; c >= 0x80 copies (c & 0x7f) + 4 bytes from a 16-bit back offset.
+// Command logs repeat verbs and filenames heavily, which this catches well.
+std::string cmd_history::lz_pack(const std::string& in) {
+    const int hash_bits = 12;
+    std::vector<int> last(1 << hash_bits, -1);
+    std::string out;
+    size_t lit_start = 0, i = 0, n = in.size();
+    auto flush_literals = [&](size_t end) {
+        while (lit_start < end) {
+            size_t run = std::min<size_t>(end - lit_start, 128);
+            out.push_back(static_cast<char>(run - 1));
+            out.append(in, lit_start, run);
+            lit_start += run;
+        }
+    };
+    while (i + 4 <= n) {
+        std::uint32_t word;
+        std::memcpy(&word, in.data() + i, 4);
+        std::uint32_t h = (word * 2654435761u) >> (32 - hash_bits);
+        int cand = last[h];
+        last[h] = static_cast<int>(i);
+        if (cand >= 0 && i - cand <= 0xffff && std::memcmp(in.data() + cand, in.data() + i, 4) == 0) {
+            size_t len = 4;
+            while (len < 131 && i + len < n && in[cand + len] == in[i + len]) ++len;
+            flush_literals(i);
+            std::uint16_t off = static_cast<std::uint16_t>(i - cand);
+            out.push_back(static_cast<char>(0x80 | (len - 4)));
+            out.push_back(static_cast<char>(off & 0xff));
+            out.push_back(static_cast<char>(off >> 8));
+            i += len;
+            lit_start = i;
+        } else {
+            ++i;
+        }
+    }
+    flush_literals(n);
+    return out;
+}
+
+std::string cmd_history::lz_unpack(const std::string& in, size_t raw_len) {
+    std::string out;
+    out.reserve(raw_len);
+    size_t pos = 0;
+    while (pos < in.size()) {
+        unsigned char c = static_cast<unsigned char>(in[pos++]);
+        if (c < 0x80) {
+            size_t run = std::min<size_t>(c + 1, in.size() - pos);
+            out.append(in, pos, run);
+            pos += run;
+        } else {
+            if (pos + 2 > in.size()) break;
+            size_t len = (c & 0x7f) + 4;
+            size_t off = static_cast<unsigned char>(in[pos]) | (static_cast<unsigned char>(in[pos + 1]) << 8);
+            pos += 2;
+            if (off == 0 || off > out.size()) break;
+            size_t from = out.size() - off;
+            for (size_t k = 0; k < len; ++k) out.push_back(out[from + k]);
+        }
+    }
+    return out;
+}
+
+#endif // CMD_HISTORY_HPP
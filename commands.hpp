@@ -3,196 +3,655 @@
 
 #include <iostream>
 #include <string>
-#include <sstream>
+#include <string_view>
+#include <chrono>
+#include <cstdint>
+#include <limits>
 #include <algorithm>
 #include "file_system.hpp"
 #include "art.hpp"
+#include "journal.hpp"
+
+// Cursor over the words of one command line. Everything it hands out is a
+// slice of the line itself, so parsing a command allocates nothing.
+class cmd_args {
+    std::string_view rest;
+
+    static bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+    void skip_space();
+
+public:
+    explicit cmd_args(std::string_view line) : rest(line) {}
+
+    // Next whitespace-delimited word.
+    bool word(std::string_view& out);
+    // Next integer, read the way operator>> reads one: leading whitespace, an
+    // optional sign, then digits up to the first non-digit. out is left
+    // untouched on failure.
+    template <typename T>
+    bool num(T& out);
+    // Everything not yet read, as is.
+    std::string_view tail() const { return rest; }
+    // The remaining text as a payload: the space that separates it from the
+    // previous word is dropped, anything after that is kept verbatim.
+    std::string_view text();
+};
+
+// ASCII case-insensitive comparison against an upper-case keyword.
+constexpr bool same_word(std::string_view word, std::string_view upper) {
+    if (word.size() != upper.size()) return false;
+    for (size_t i = 0; i < word.size(); ++i) {
+        char c = word[i];
+        if (c >= 'a' && c <= 'z') c = static_cast<char>(c - 'a' + 'A');
+        if (c != upper[i]) return false;
+    }
+    return true;
+}
+
+// Perfect hash over a fixed set of verbs, built at compile time: the
+// constructor searches for a seed under which every verb lands in a slot of
+// its own, so a lookup hashes the word once and compares it with at most one
+// verb. The hash folds ASCII case, so verbs match case-insensitively.
+template <size_t N, size_t Slots = 128>
+class verb_index {
+    static_assert(N < 128 && (Slots & (Slots - 1)) == 0, "verb_index: too many verbs or slots not a power of two");
+
+    std::string_view names[N];
+    std::int8_t slot_of[Slots];
+    std::uint32_t seed;
+
+    static constexpr std::uint32_t upper(char c) {
+        return static_cast<unsigned char>(c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c);
+    }
+    static constexpr size_t hash(std::string_view w, std::uint32_t seed) {
+        std::uint32_t h = 2166136261u ^ seed;
+        for (char c : w) h = (h ^ upper(c)) * 16777619u;
+        return (h ^ (h >> 15)) & (Slots - 1);
+    }
+
+public:
+    template <typename Entry>
+    constexpr explicit verb_index(const Entry (&table)[N]) : names(), slot_of(), seed(0) {
+        for (size_t i = 0; i < N; ++i) names[i] = table[i].name;
+        for (;; ++seed) {
+            for (size_t s = 0; s < Slots; ++s) slot_of[s] = -1;
+            bool placed = true;
+            for (size_t i = 0; i < N && placed; ++i) {
+                size_t s = hash(names[i], seed);
+                if (slot_of[s] >= 0) placed = false;
+                else slot_of[s] = static_cast<std::int8_t>(i);
+            }
+            if (placed) break;
+        }
+    }
+
+    // Index of word in the table, or -1.
+    constexpr int find(std::string_view word) const {
+        int i = slot_of[hash(word, seed)];
+        return i >= 0 && same_word(word, names[i]) ? i : -1;
+    }
+};
 
 class CommandHandler {
 private:
+    using handler = void (CommandHandler::*)(cmd_args&);
+    struct verb {
+        std::string_view name;
+        handler run;
+        bool mutating;
+        bool per_file;
+    };
+
     file_system& fs;
     ArtMode& art;
+    journal* jrn = nullptr;
+    bool replaying = false;
+    bool exiting = false;
+
+    void run_create(cmd_args& a);
+    void run_read(cmd_args& a);
+    void run_insert(cmd_args& a);
+    void run_update(cmd_args& a);
+    void run_snapshot(cmd_args& a);
+    void run_rollback(cmd_args& a);
+    void run_history(cmd_args& a);
+    void run_recent(cmd_args& a);
+    void run_biggest(cmd_args& a);
+    void run_command_history(cmd_args& a);
+    void run_artmode(cmd_args& a);
+    void run_rename(cmd_args& a);
+    void run_switch(cmd_args& a);
+    void run_lca(cmd_args& a);
+    void run_diff(cmd_args& a);
+    void run_merge(cmd_args& a);
+    void run_prune(cmd_args& a);
+    void run_gc(cmd_args& a);
+    void run_read_at(cmd_args& a);
+    void run_switch_at(cmd_args& a);
+    void run_export_at(cmd_args& a);
+    void run_search(cmd_args& a);
+    void run_current_version(cmd_args& a);
+    void run_tree(cmd_args& a);
+    void run_storage(cmd_args& a);
+    void run_stats(cmd_args& a);
+    void run_checkpoint(cmd_args& a);
+    void run_load(cmd_args& a);
+    void run_help(cmd_args& a);
+    void run_exit(cmd_args& a);
+
+    void at_time(cmd_args& a, const char* name, bool do_switch);
+
+    // Every verb, its handler, whether it changes state (those are the
+    // commands the journal records), and whether it only touches the file
+    // named by its first argument (those may run in parallel with commands
+    // on other files).
+    static constexpr verb verbs[] = {
+        {"CREATE", &CommandHandler::run_create, true, false},
+        {"READ", &CommandHandler::run_read, false, true},
+        {"INSERT", &CommandHandler::run_insert, true, true},
+        {"UPDATE", &CommandHandler::run_update, true, true},
+        {"SNAPSHOT", &CommandHandler::run_snapshot, true, true},
+        {"ROLLBACK", &CommandHandler::run_rollback, true, true},
+        {"HISTORY", &CommandHandler::run_history, false, true},
+        {"RECENT", &CommandHandler::run_recent, false, false},
+        {"BIGGEST", &CommandHandler::run_biggest, false, false},
+        {"COMMAND_HISTORY", &CommandHandler::run_command_history, false, false},
+        {"ARTMODE", &CommandHandler::run_artmode, false, false},
+        {"RENAME", &CommandHandler::run_rename, true, false},
+        {"SWITCH", &CommandHandler::run_switch, true, true},
+        {"LCA", &CommandHandler::run_lca, false, true},
+        {"DIFF", &CommandHandler::run_diff, false, true},
+        {"MERGE", &CommandHandler::run_merge, true, true},
+        {"PRUNE", &CommandHandler::run_prune, true, true},
+        {"GC", &CommandHandler::run_gc, false, false},
+        {"READ_AT", &CommandHandler::run_read_at, false, true},
+        {"SWITCH_AT", &CommandHandler::run_switch_at, true, true},
+        {"EXPORT_AT", &CommandHandler::run_export_at, false, false},
+        {"SEARCH", &CommandHandler::run_search, false, false},
+        {"CURRENT_VERSION", &CommandHandler::run_current_version, false, true},
+        {"TREE", &CommandHandler::run_tree, false, true},
+        {"STORAGE", &CommandHandler::run_storage, true, false},
+        {"STATS", &CommandHandler::run_stats, false, false},
+        {"CHECKPOINT", &CommandHandler::run_checkpoint, false, false},
+        {"LOAD", &CommandHandler::run_load, false, false},
+        {"HELP", &CommandHandler::run_help, false, false},
+        {"EXIT", &CommandHandler::run_exit, false, false},
+    };
+    static constexpr verb_index<sizeof(verbs) / sizeof(verbs[0])> lookup{verbs};
+
+    // Runs one GC slice. How far a time-bounded slice gets depends on the
+    // machine, so the journal records where it stopped ("GC TO h id") rather
+    // than the command, and replay prunes exactly the same versions.
+    gc_cursor gc_slice(int budget_ms, gc_cursor until = {1 << 30, 0}) {
+        auto deadline = budget_ms > 0 ? std::chrono::steady_clock::now() + std::chrono::milliseconds(budget_ms)
+                                       : std::chrono::steady_clock::time_point::max();
+        gc_cursor at = fs.gc_run(deadline, until);
+        if (jrn) jrn->append(now_ts(), "GC TO " + std::to_string(at.handle) + " " + std::to_string(at.next_id));
+        return at;
+    }
 
 public:
     CommandHandler(file_system& fs_ref, ArtMode& art_ref)
         : fs(fs_ref), art(art_ref) {}
 
-    void execute(const std::string& cmd_line) {
-        std::istringstream iss(cmd_line);
-        std::string cmd;
-        iss >> cmd;
+    void attach_journal(journal* j) { jrn = j; }
+    // Set while a journal is replayed: automatic GC stays off then, since the
+    // slices it ran originally are in the journal themselves.
+    void set_replaying(bool on) { replaying = on; }
+
+    // Returns false once EXIT has been handled.
+    bool execute(std::string_view cmd_line);
+
+    // execute() in steps, for the parallel batch engine. admit() does the
+    // bookkeeping that must follow input order (command history, journal)
+    // and returns the time to pin the command to; run() executes it, on any
+    // thread. gc_due() counts it toward the automatic GC policy, also in
+    // input order, and says whether a slice must follow it; gc_tick() runs
+    // that slice once nothing else is running.
+    time_t admit(std::string_view cmd_line, int verb);
+    void run(std::string_view cmd_line, int verb, time_t pin);
+    bool gc_due(int verb);
+    void gc_tick(time_t pin);
+
+    // Verb of a line (-1 if unknown) and its first argument.
+    static int classify(std::string_view cmd_line, std::string_view& first_arg);
+    static bool per_file(int verb) { return verb >= 0 && verbs[verb].per_file; }
+
+    // Tokenizes a line and resolves its verb without running anything; the
+    // batch mode uses it to time parsing on its own. Returns the number of
+    // words on the line.
+    static int parse_only(std::string_view cmd_line, int& verb_out);
+};
+
+// Implementation
+void cmd_args::skip_space() {
+    size_t i = 0;
+    while (i < rest.size() && is_space(rest[i])) ++i;
+    rest.remove_prefix(i);
+}
+
+bool cmd_args::word(std::string_view& out) {
+    skip_space();
+    if (rest.empty()) return false;
+    size_t i = 0;
+    while (i < rest.size() && !is_space(rest[i])) ++i;
+    out = rest.substr(0, i);
+    rest.remove_prefix(i);
+    return true;
+}
+
+template <typename T>
+bool cmd_args::num(T& out) {
+    skip_space();
+    size_t i = 0;
+    bool neg = false;
+    if (i < rest.size() && (rest[i] == '-' || rest[i] == '+')) neg = rest[i++] == '-';
+    size_t digits = i;
+    long long v = 0;
+    const long long cap = static_cast<long long>(std::numeric_limits<T>::max());
+    for (; i < rest.size() && rest[i] >= '0' && rest[i] <= '9'; ++i) {
+        int d = rest[i] - '0';
+        if (v > (cap - d) / 10) return false;
+        v = v * 10 + d;
+    }
+    if (i == digits) return false;
+    out = static_cast<T>(neg ? -v : v);
+    rest.remove_prefix(i);
+    return true;
+}
+
+std::string_view cmd_args::text() {
+    std::string_view t = rest;
+    if (!t.empty() && t[0] == ' ') t.remove_prefix(1);
+    rest = std::string_view();
+    return t;
+}
+
+bool CommandHandler::execute(std::string_view cmd_line) {
+    std::string_view first_arg;
+    int v = classify(cmd_line, first_arg);
+    time_t pin = admit(cmd_line, v);
+    run(cmd_line, v, pin);
+    if (exiting) return false;
+    if (gc_due(v)) gc_tick(pin);
+    return true;
+}
+
+int CommandHandler::classify(std::string_view cmd_line, std::string_view& first_arg) {
+    cmd_args args(cmd_line);
+    std::string_view word;
+    args.word(word);
+    first_arg = std::string_view();
+    args.word(first_arg);
+    return lookup.find(word);
+}
+
+// Mutating commands are pinned to the time they were journaled, so replay
+// reproduces their timestamps.
+time_t CommandHandler::admit(std::string_view cmd_line, int verb) {
+    fs.command_history.push(cmd_line);
+    if (!jrn || verb < 0 || !verbs[verb].mutating) return pinned_ts();
+    time_t t = now_ts();
+    jrn->append(t, cmd_line);
+    return t;
+}
+
+void CommandHandler::run(std::string_view cmd_line, int verb, time_t pin) {
+    cmd_args args(cmd_line);
+    std::string_view word;
+    args.word(word);
+    time_t prev_pin = pinned_ts();
+    pinned_ts() = pin;
+    if (verb >= 0) {
+        (this->*verbs[verb].run)(args);
+    } else {
+        std::string cmd(word);
         std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+        art.display("Unknown command: " + cmd);
+    }
+    pinned_ts() = prev_pin;
+}
 
-        fs.command_history.push(cmd_line);
+bool CommandHandler::gc_due(int verb) {
+    return !replaying && verb >= 0 && verbs[verb].mutating && fs.gc_due();
+}
 
-        if (cmd == "CREATE") {
-            std::string filename;
-            if (iss >> filename) {
-                std::string created_name = fs.create_file(filename);
-                if (!created_name.empty())
-                    std::cout << "'" << created_name << "' has been created." << std::endl;
-                else
-                    std::cout << "File creation failed." << std::endl;
-            }
-            else {
-                std::string created_name = fs.create_file();
-                if (!created_name.empty())
-                    std::cout << "'" << created_name << "' has been created." << std::endl;
-                else
-                    std::cout << "File creation failed." << std::endl;
-            }
-        }
-        else if (cmd == "READ") {
-            std::string filename;
-            if (iss >> filename) {
-                std::cout << "'" << filename << "' : ";
-                fs.read_file(filename);
-            }
-            else std::cout << "Usage: READ <filename>" << std::endl;
-        }
-        else if (cmd == "INSERT") {
-            std::string filename, text;
-            if (iss >> filename) {
-                std::getline(iss, text);
-                if (!text.empty() && text[0] == ' ') text.erase(0, 1);
-                fs.insert_into_file(filename, text);
-            }
-            else std::cout << "Usage: INSERT <filename> <text>" << std::endl;
-        }
-        else if (cmd == "UPDATE") {
-            std::string filename, text;
-            if (iss >> filename) {
-                std::getline(iss, text);
-                if (!text.empty() && text[0] == ' ') text.erase(0, 1);
-                fs.update_file(filename, text);
-            }
-            else std::cout << "Usage: UPDATE <filename> <text>" << std::endl;
-        }
-        else if (cmd == "SNAPSHOT") {
-            std::string filename, message;
-            if (iss >> filename) {
-                std::getline(iss, message);
-                if (!message.empty() && message[0] == ' ') message.erase(0, 1);
-                fs.snapshot_file(filename, message);
-            }
-            else std::cout << "Usage: SNAPSHOT <filename> <message>" << std::endl;
-        }
-        else if (cmd == "ROLLBACK") {
-            std::string filename;
-            int ver_id = -1;
-            if (iss >> filename) {
-                if (iss >> ver_id)
-                    fs.rb_file(filename, ver_id);
-                else
-                    fs.rb_file(filename);
-            }
-            else std::cout << "Usage: ROLLBACK <filename> [version_id]" << std::endl;
-        }
-        else if (cmd == "HISTORY") {
-            std::string filename;
-            if (iss >> filename) {
-                std::cout << "-----------------------------------------" << std::endl;
-                std::cout << "History of '" << filename << "' :" << std::endl;
-                fs.show_history(filename);
-                std::cout << "-----------------------------------------" << std::endl;
-            }
-            else std::cout << "Usage: HISTORY <filename>" << std::endl;
-        }
-        else if (cmd == "RECENT") {
-            int num = 5;
-            iss >> num;
-            fs.recent_files(num);
-        }
-        else if (cmd == "BIGGEST") {
-            int num = 5;
-            iss >> num;
-            fs.biggest_trees(num);
-        }
-        else if (cmd == "COMMAND_HISTORY") {
-            fs.show_command_history();
-        }
-        else if (cmd == "ARTMODE") {
-            std::string mode;
-            if (iss >> mode)
-                art.set_enabled(mode == "ON" || mode == "on");
-            else
-                std::cout << "Usage: ARTMODE ON|OFF" << std::endl;
-        }
-        else if (cmd == "RENAME") {
-            std::string old_name, new_name;
-            if (iss >> old_name >> new_name) {
-                if (!fs.rnm_file(old_name, new_name))
-                    std::cout << "Rename failed." << std::endl;
-            }
-            else {
-                std::cout << "Usage: RENAME <old_filename> <new_filename>" << std::endl;
-            }
-        }
-        else if (cmd == "SWITCH") {
-            std::string filename;
-            int version_id;
-            if (iss >> filename >> version_id) {
-                fs.switch_version(filename, version_id);
-            } else {
-                std::cout << "Usage: SWITCH <filename> <version_id>" << std::endl;
-            }
-        }
-        else if (cmd == "CURRENT_VERSION") {
-            std::string filename;
-            if (iss >> filename) {
-                fs.show_active_version(filename);
-            } else {
-                std::cout << "Usage: CURRENT_VERSION <filename>" << std::endl;
-            }
-        }
-        else if (cmd == "TREE") {
-            std::string filename;
-            if (iss >> filename) {
-                std::cout << "-----------------------------------------" << std::endl;
-                std::cout << "VERSION TREE of '" << filename << "' :" << std::endl;
-                fl* f_ptr = nullptr;
-                if (fs.files_map.find(filename, f_ptr) && f_ptr) {
-                    if (art.is_enabled()) {
-                        art.show_version_tree_bubbles(f_ptr->find_ver(0));
-                    }
-                    else {
-                        fs.print_version_tree(filename, false);
-                    }
-                }
-                else std::cout << "File '" << filename << "' not found." << std::endl;
-            }
-            else std::cout << "Usage: TREE <filename>" << std::endl;
-        }
-        else if (cmd == "HELP") {
-            std::cout << "-----------------------------------------" << std::endl;
-            art.display("Available commands with descriptions:");
-            art.display("CREATE <filename>       : Create a new file (or 'Untitled' if no name given)");
-            art.display("READ <filename>         : Display contents of a file");
-            art.display("INSERT <filename> <text>: Insert text at the end of a file");
-            art.display("UPDATE <filename> <text>: Overwrite file contents with new text");
-            art.display("SNAPSHOT <filename> <msg>: Save a version of the file with a message");
-            art.display("ROLLBACK <filename> [id]: Revert file to a previous version by ID");
-            art.display("HISTORY <filename>      : Show all snapshots and messages of a file");
-            art.display("RECENT [num]            : Show the most recently accessed files (default 5)");
-            art.display("BIGGEST [num]           : Show files with largest version trees (default 5)");
-            art.display("COMMAND_HISTORY         : Show history of executed commands");
-            art.display("ARTMODE ON|OFF          : Enable or disable Art Mode for nicer output");
-            art.display("RENAME <old> <new>      : Rename a file");
-            art.display("TREE <filename>         : Display the version tree of a file visually");
-            art.display("HELP                    : Show this help menu with descriptions");
-            art.display("EXIT                    : Exit the program");
-            std::cout << "-----------------------------------------" << std::endl;
+void CommandHandler::gc_tick(time_t pin) {
+    time_t prev_pin = pinned_ts();
+    pinned_ts() = pin;
+    gc_slice(fs.gc_budget());
+    pinned_ts() = prev_pin;
+}
+
+int CommandHandler::parse_only(std::string_view cmd_line, int& verb_out) {
+    cmd_args args(cmd_line);
+    std::string_view word;
+    int n = 0;
+    verb_out = -1;
+    if (args.word(word)) {
+        verb_out = lookup.find(word);
+        ++n;
+    }
+    while (args.word(word)) ++n;
+    return n;
+}
+
+void CommandHandler::run_create(cmd_args& a) {
+    std::string_view filename;
+    std::string created_name = a.word(filename) ? fs.create_file(std::string(filename)) : fs.create_file();
+    if (!created_name.empty())
+        console() << "'" << created_name << "' has been created." << std::endl;
+    else
+        console() << "File creation failed." << std::endl;
+}
+
+void CommandHandler::run_read(cmd_args& a) {
+    std::string_view filename;
+    if (a.word(filename)) {
+        console() << "'" << filename << "' : ";
+        fs.read_file(filename);
+    }
+    else console() << "Usage: READ <filename>" << std::endl;
+}
+
+void CommandHandler::run_insert(cmd_args& a) {
+    std::string_view filename;
+    if (a.word(filename)) fs.insert_into_file(filename, a.text());
+    else console() << "Usage: INSERT <filename> <text>" << std::endl;
+}
+
+void CommandHandler::run_update(cmd_args& a) {
+    std::string_view filename;
+    if (a.word(filename)) fs.update_file(filename, a.text());
+    else console() << "Usage: UPDATE <filename> <text>" << std::endl;
+}
+
+void CommandHandler::run_snapshot(cmd_args& a) {
+    std::string_view filename;
+    if (a.word(filename)) fs.snapshot_file(filename, a.text());
+    else console() << "Usage: SNAPSHOT <filename> <message>" << std::endl;
+}
+
+void CommandHandler::run_rollback(cmd_args& a) {
+    std::string_view filename;
+    int ver_id = -1;
+    if (a.word(filename)) {
+        if (a.num(ver_id))
+            fs.rb_file(filename, ver_id);
+        else
+            fs.rb_file(filename);
+    }
+    else console() << "Usage: ROLLBACK <filename> [version_id]" << std::endl;
+}
+
+void CommandHandler::run_history(cmd_args& a) {
+    std::string_view filename;
+    int limit = -1, offset = 0;
+    if (a.word(filename)) {
+        if (a.num(limit)) a.num(offset);
+        console() << "-----------------------------------------" << std::endl;
+        console() << "History of '" << filename << "' :" << std::endl;
+        fs.show_history(filename, limit, offset);
+        console() << "-----------------------------------------" << std::endl;
+    }
+    else console() << "Usage: HISTORY <filename> [limit] [offset]" << std::endl;
+}
+
+void CommandHandler::run_recent(cmd_args& a) {
+    int num = 5;
+    a.num(num);
+    fs.recent_files(num);
+}
+
+void CommandHandler::run_biggest(cmd_args& a) {
+    int num = 5;
+    a.num(num);
+    fs.biggest_trees(num);
+}
+
+void CommandHandler::run_command_history(cmd_args& a) {
+    long long limit = -1, offset = 0;
+    if (a.num(limit)) a.num(offset);
+    fs.show_command_history(limit, offset);
+}
+
+void CommandHandler::run_artmode(cmd_args& a) {
+    std::string_view mode;
+    if (a.word(mode))
+        art.set_enabled(mode == "ON" || mode == "on");
+    else
+        console() << "Usage: ARTMODE ON|OFF" << std::endl;
+}
+
+void CommandHandler::run_rename(cmd_args& a) {
+    std::string_view old_name, new_name;
+    if (a.word(old_name) && a.word(new_name)) {
+        if (!fs.rnm_file(std::string(old_name), std::string(new_name)))
+            console() << "Rename failed." << std::endl;
+    }
+    else {
+        console() << "Usage: RENAME <old_filename> <new_filename>" << std::endl;
+    }
+}
+
+void CommandHandler::run_switch(cmd_args& a) {
+    std::string_view filename;
+    int version_id;
+    if (a.word(filename) && a.num(version_id)) {
+        fs.switch_version(filename, version_id);
+    } else {
+        console() << "Usage: SWITCH <filename> <version_id>" << std::endl;
+    }
+}
+
+void CommandHandler::run_lca(cmd_args& a) {
+    std::string_view filename;
+    int ver_a, ver_b;
+    if (a.word(filename) && a.num(ver_a) && a.num(ver_b)) fs.show_lca(filename, ver_a, ver_b);
+    else console() << "Usage: LCA <filename> <version_a> <version_b>" << std::endl;
+}
+
+void CommandHandler::run_diff(cmd_args& a) {
+    std::string_view filename;
+    int ver_a, ver_b;
+    if (a.word(filename) && a.num(ver_a) && a.num(ver_b)) fs.diff_versions(filename, ver_a, ver_b);
+    else console() << "Usage: DIFF <filename> <version_a> <version_b>" << std::endl;
+}
+
+void CommandHandler::run_merge(cmd_args& a) {
+    std::string_view filename;
+    int ours, theirs;
+    if (a.word(filename) && a.num(ours) && a.num(theirs)) fs.merge_versions(filename, ours, theirs);
+    else console() << "Usage: MERGE <filename> <version_a> <version_b>" << std::endl;
+}
+
+void CommandHandler::run_prune(cmd_args& a) {
+    std::string_view filename;
+    if (a.word(filename)) fs.prune_file(filename);
+    else console() << "Usage: PRUNE <filename>" << std::endl;
+}
+
+void CommandHandler::run_gc(cmd_args& a) {
+    std::string_view arg;
+    a.word(arg);
+    if (same_word(arg, "AUTO")) {
+        int every = 0, budget = 2;
+        if (a.num(every)) a.num(budget);
+        fs.set_gc_policy(every, budget);
+        if (every > 0) console() << "GC runs a " << fs.gc_budget() << " ms slice every " << every << " changes." << std::endl;
+        else console() << "Automatic GC is off." << std::endl;
+        return;
+    }
+    gc_cursor until{1 << 30, 0};
+    int budget = 0;
+    bool ok = true;
+    if (same_word(arg, "TO")) ok = a.num(until.handle) && a.num(until.next_id);
+    else if (!arg.empty()) ok = cmd_args(arg).num(budget);
+    if (!ok) {
+        console() << "Usage: GC [budget_ms] | GC AUTO <every_n_changes> [budget_ms]" << std::endl;
+        return;
+    }
+    prune_stats before = fs.gc_stats();
+    if (fs.gc_done()) before = prune_stats();
+    auto start = std::chrono::steady_clock::now();
+    gc_cursor at = gc_slice(budget, until);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const prune_stats& st = fs.gc_stats();
+    console() << "GC pruned " << st.versions - before.versions << " versions, reclaimed "
+              << st.bytes - before.bytes << " bytes in " << fmt_ms(ms) << " ms";
+    if (fs.gc_done()) console() << " (sweep complete)." << std::endl;
+    else console() << " (paused at file " << at.handle + 1 << " of " << fs.file_cnt()
+                   << "; run GC again to continue)." << std::endl;
+}
+
+void CommandHandler::at_time(cmd_args& a, const char* name, bool do_switch) {
+    std::string_view filename;
+    time_t t;
+    if (a.word(filename) && !a.tail().empty() && parse_ts(std::string(a.tail()), t)) {
+        if (do_switch) fs.switch_at(filename, t);
+        else fs.read_at(filename, t);
+    }
+    else console() << "Usage: " << name << " <filename> <epoch seconds | YYYY-MM-DD HH:MM[:SS]>" << std::endl;
+}
+
+void CommandHandler::run_read_at(cmd_args& a) { at_time(a, "READ_AT", false); }
+
+void CommandHandler::run_switch_at(cmd_args& a) { at_time(a, "SWITCH_AT", true); }
+
+void CommandHandler::run_export_at(cmd_args& a) {
+    std::string_view word, clock, path;
+    std::string stamp;
+    time_t t;
+    if (a.word(word)) {
+        stamp = word;
+        // A date and a clock time arrive as two words.
+        if (stamp.find_first_not_of("0123456789") != std::string::npos && stamp.find(':') == std::string::npos
+            && a.word(clock)) stamp.append(" ").append(clock);
+        a.word(path);
+    }
+    if (parse_ts(stamp, t)) fs.export_at(t, std::string(path));
+    else console() << "Usage: EXPORT_AT <epoch seconds | YYYY-MM-DD HH:MM[:SS]> [path]" << std::endl;
+}
+
+// SEARCH <word> [file] or SEARCH "some words" [file]
+void CommandHandler::run_search(cmd_args& a) {
+    std::string_view rest = a.tail(), pattern, filename;
+    size_t b = rest.find_first_not_of(' ');
+    if (b != std::string_view::npos && rest[b] == '"') {
+        size_t e = rest.find('"', b + 1);
+        if (e != std::string_view::npos) {
+            pattern = rest.substr(b + 1, e - b - 1);
+            cmd_args(rest.substr(e + 1)).word(filename);
         }
-        else if (cmd == "EXIT") {
-            std::cout << "-----------------------------------------" << std::endl;
-            art.display("Exiting...");
-            if (art.is_enabled()) art.show_bye();
-            exit(0);
+    } else {
+        a.word(pattern);
+        a.word(filename);
+    }
+    if (!pattern.empty()) fs.search(std::string(pattern), std::string(filename));
+    else console() << "Usage: SEARCH <pattern | \"quoted pattern\"> [filename]" << std::endl;
+}
+
+void CommandHandler::run_current_version(cmd_args& a) {
+    std::string_view filename;
+    if (a.word(filename)) {
+        fs.show_active_version(filename);
+    } else {
+        console() << "Usage: CURRENT_VERSION <filename>" << std::endl;
+    }
+}
+
+void CommandHandler::run_tree(cmd_args& a) {
+    std::string_view filename;
+    int from = -1, max_depth = -1;
+    if (a.word(filename)) {
+        if (a.num(from)) a.num(max_depth);
+        console() << "-----------------------------------------" << std::endl;
+        console() << "VERSION TREE of '" << filename << "' :" << std::endl;
+        if (art.is_enabled()) {
+            art.show_version_tree_bubbles(fs.tree_top(filename, from), max_depth);
         }
         else {
-            art.display("Unknown command: " + cmd);
+            fs.print_version_tree(filename, from, max_depth);
         }
     }
-};
+    else console() << "Usage: TREE <filename> [from_version] [max_depth]" << std::endl;
+}
+
+void CommandHandler::run_storage(cmd_args& a) {
+    std::string_view mode;
+    int k = 16;
+    if (a.word(mode) && same_word(mode, "FULL")) fs.set_storage(0);
+    else if (same_word(mode, "DELTA")) { a.num(k); fs.set_storage(k); }
+    else console() << "Usage: STORAGE FULL|DELTA [k]" << std::endl;
+}
+
+void CommandHandler::run_stats(cmd_args&) {
+    console() << "-----------------------------------------" << std::endl;
+    fs.show_stats();
+    console() << "-----------------------------------------" << std::endl;
+}
+
+void CommandHandler::run_checkpoint(cmd_args& a) {
+    std::string_view path;
+    if (!a.word(path)) console() << "Usage: CHECKPOINT <path>" << std::endl;
+    else if (!jrn) fs.save_checkpoint(std::string(path));
+    else {
+        // The covered records must be on disk before a checkpoint says so.
+        jrn->sync();
+        fs.save_checkpoint(std::string(path), jrn->record_cnt(), jrn->last_checksum());
+    }
+}
+
+// The journal cannot replay a LOAD faithfully (the checkpoint may have
+// changed or gone by then), so while one is open a checkpoint can only be
+// loaded at startup with --load.
+void CommandHandler::run_load(cmd_args& a) {
+    std::string_view path;
+    if (jrn) console() << "LOAD is not available while journaling; restart with --load <path>." << std::endl;
+    else if (a.word(path)) fs.load_checkpoint(std::string(path));
+    else console() << "Usage: LOAD <path>" << std::endl;
+}
+
+void CommandHandler::run_help(cmd_args&) {
+    console() << "-----------------------------------------" << std::endl;
+    art.display("Available commands with descriptions:");
+    art.display("CREATE <filename>       : Create a new file (or 'Untitled' if no name given)");
+    art.display("READ <filename>         : Display contents of a file");
+    art.display("INSERT <filename> <text>: Insert text at the end of a file");
+    art.display("UPDATE <filename> <text>: Overwrite file contents with new text");
+    art.display("SNAPSHOT <filename> <msg>: Save a version of the file with a message");
+    art.display("ROLLBACK <filename> [id]: Revert file to a previous version by ID");
+    art.display("HISTORY <filename> [n] [skip]: Show snapshots and messages (the n latest after skipping skip)");
+    art.display("RECENT [num]            : Show the most recently accessed files (default 5)");
+    art.display("BIGGEST [num]           : Show files with largest version trees (default 5)");
+    art.display("COMMAND_HISTORY [n] [skip]: Show executed commands, newest first (n of them, after skipping skip)");
+    art.display("ARTMODE ON|OFF          : Enable or disable Art Mode for nicer output");
+    art.display("RENAME <old> <new>      : Rename a file");
+    art.display("LCA <filename> <v1> <v2>: Show the lowest common ancestor of two versions");
+    art.display("DIFF <filename> <v1> <v2>: Show what changed from version v1 to version v2");
+    art.display("MERGE <filename> <v1> <v2>: Merge v2 into snapshot v1 as a new active version");
+    art.display("READ_AT <filename> <t>  : Show the file as of its latest snapshot at or before time t");
+    art.display("SWITCH_AT <filename> <t>: Switch to the latest snapshot at or before time t");
+    art.display("EXPORT_AT <t> [path]    : Write every file as it stood at time t (to path, or here)");
+    art.display("SEARCH <pattern> [file] : List the versions containing pattern (quote it to include spaces)");
+    art.display("PRUNE <filename>        : Drop unsnapshotted versions that are not active");
+    art.display("GC [ms]                 : Prune all files, in slices of at most ms milliseconds");
+    art.display("GC AUTO <n> [ms]        : Run a GC slice after every n changes (0 turns it off)");
+    art.display("TREE <filename> [v] [d] : Display the version tree of a file (from version v, d levels deep)");
+    art.display("STORAGE FULL|DELTA [k]  : Store full copies, or deltas with a keyframe every k versions");
+    art.display("STATS                   : Show storage use per version and reconstruction time");
+    art.display("CHECKPOINT <path>       : Save every file and its version tree to a checkpoint");
+    art.display("LOAD <path>             : Load the files of a checkpoint (trees are read on first use)");
+    art.display("HELP                    : Show this help menu with descriptions");
+    art.display("EXIT                    : Exit the program");
+    console() << "-----------------------------------------" << std::endl;
+}
+
+void CommandHandler::run_exit(cmd_args&) {
+    console() << "-----------------------------------------" << std::endl;
+    art.display("Exiting...");
+    if (art.is_enabled()) art.show_bye();
+    exiting = true;
+}
 
 #endif // COMMANDS_HPP
@@ -0,0 +1,318 @@
+#ifndef DIFF_HPP
+#define DIFF_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "hash.hpp"
+
+// Token-level diff of two texts. Texts that contain newlines are compared
+// line by line; single-line texts (everything typed through INSERT/UPDATE)
+// word by word, each word keeping its trailing whitespace so the tokens
+// concatenate back to the text. Line mode can also be forced, so that
+// several diffs against one base agree on their token boundaries.
+//
+// The common head and tail are trimmed first with a word-at-a-time byte
+// compare, so only the middle is tokenized and hashed. That middle goes
+// through Myers' linear-space O((N+M)D) algorithm: a bisection finds the
+// middle snake and both halves are solved recursively. A subproblem whose
+// edit distance exceeds max_cost is reported as one replaced block instead,
+// which bounds the worst case on unrelated texts.
+class text_diff {
+public:
+    // a[a_off, a_off + a_len) was replaced by b[b_off, b_off + b_len).
+    struct hunk {
+        size_t a_off, a_len;
+        size_t b_off, b_len;
+        size_t deleted, inserted;
+    };
+
+    text_diff(const std::string& a, const std::string& b, int max_cost = 1 << 14, bool force_lines = false);
+
+    const std::vector<hunk>& hunks() const { return changes; }
+    bool line_mode() const { return by_line; }
+    size_t a_tokens() const { return head_tokens(a) + ta.size(); }
+    size_t b_tokens() const { return head_tokens(b) + tb.size(); }
+    size_t deleted() const;
+    size_t inserted() const;
+
+    // Appends the diff to out: context is cut down to ctx tokens around each
+    // change, deletions read [-...-] and insertions {+...+} (word mode) or
+    // lines prefixed "- " / "+ " (line mode).
+    void render(std::string& out, int ctx = 3) const;
+
+    static size_t common_prefix(const char* a, const char* b, size_t n);
+    static size_t common_suffix(const char* a_end, const char* b_end, size_t n);
+
+private:
+    struct token {
+        size_t off;
+        size_t len;
+        std::uint64_t hash;
+    };
+
+    const std::string& a;
+    const std::string& b;
+    bool by_line;
+    size_t lo;
+    size_t a_hi, b_hi;
+    std::vector<token> ta, tb;
+    std::vector<char> del, ins;
+    std::vector<int> vf, vb;
+    int max_cost;
+    std::vector<hunk> changes;
+
+    bool is_space(char c) const { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+    bool boundary(const std::string& s, size_t i) const;
+    size_t next_boundary(const std::string& s, size_t i) const;
+    size_t prev_boundary(const std::string& s, size_t i) const;
+    size_t head_tokens(const std::string& s) const;
+    void tokenize(const std::string& s, size_t from, size_t to, std::vector<token>& out) const;
+    bool same(int i, int j) const;
+    void solve(int a0, int a1, int b0, int b1);
+    bool bisect(int a0, int a1, int b0, int b1, int& x_out, int& y_out);
+    void collect();
+    void render_same(std::string& out, size_t from, size_t to, bool first, bool last, int ctx) const;
+    void render_text(std::string& out, const std::string& s, size_t off, size_t len, const char* pre, const char* post, char mark) const;
+};
+
+// Implementation
+text_diff::text_diff(const std::string& ta_text, const std::string& tb_text, int cost, bool force_lines)
+    : a(ta_text), b(tb_text), by_line(false), lo(0), a_hi(0), b_hi(0), max_cost(cost > 0 ? cost : 1) {
+    by_line = force_lines || a.find('\n') != std::string::npos || b.find('\n') != std::string::npos;
+    size_t na = a.size(), nb = b.size();
+    size_t pre = common_prefix(a.data(), b.data(), std::min(na, nb));
+    if (pre == na && pre == nb) {
+        lo = a_hi = b_hi = na;
+        return;
+    }
+    // Within the shared bytes a boundary in one text is one in the other, so
+    // only the cut at pre itself has to be checked on both sides.
+    lo = pre;
+    while (lo > 0 && !(boundary(a, lo) && boundary(b, lo))) --lo;
+    size_t suf = common_suffix(a.data() + na, b.data() + nb, std::min(na, nb) - lo);
+    a_hi = na - suf;
+    b_hi = nb - suf;
+    while (a_hi < na && !(boundary(a, a_hi) && boundary(b, b_hi))) { ++a_hi; ++b_hi; }
+
+    tokenize(a, lo, a_hi, ta);
+    tokenize(b, lo, b_hi, tb);
+    del.assign(ta.size(), 0);
+    ins.assign(tb.size(), 0);
+    solve(0, static_cast<int>(ta.size()), 0, static_cast<int>(tb.size()));
+    collect();
+}
+
+// Eight bytes per step; the first differing word is finished bytewise.
+size_t text_diff::common_prefix(const char* a, const char* b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        std::uint64_t x, y;
+        std::memcpy(&x, a + i, 8);
+        std::memcpy(&y, b + i, 8);
+        if (x != y) break;
+    }
+    while (i < n && a[i] == b[i]) ++i;
+    return i;
+}
+
+// Same, walking backwards from one past the last byte of each text.
+size_t text_diff::common_suffix(const char* a_end, const char* b_end, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        std::uint64_t x, y;
+        std::memcpy(&x, a_end - i - 8, 8);
+        std::memcpy(&y, b_end - i - 8, 8);
+        if (x != y) break;
+    }
+    while (i < n && a_end[-1 - (long)i] == b_end[-1 - (long)i]) ++i;
+    return i;
+}
+
+bool text_diff::boundary(const std::string& s, size_t i) const {
+    if (i == 0 || i >= s.size()) return true;
+    if (by_line) return s[i - 1] == '\n';
+    return is_space(s[i - 1]) && !is_space(s[i]);
+}
+
+size_t text_diff::next_boundary(const std::string& s, size_t i) const {
+    do ++i; while (i < s.size() && !boundary(s, i));
+    return std::min(i, s.size());
+}
+
+size_t text_diff::prev_boundary(const std::string& s, size_t i) const {
+    do --i; while (i > 0 && !boundary(s, i));
+    return i;
+}
+
+size_t text_diff::head_tokens(const std::string& s) const {
+    size_t n = 0;
+    for (size_t i = 0; i < lo; i = next_boundary(s, i)) ++n;
+    size_t hi = &s == &a ? a_hi : b_hi;
+    for (size_t i = hi; i < s.size(); i = next_boundary(s, i)) ++n;
+    return n;
+}
+
+void text_diff::tokenize(const std::string& s, size_t from, size_t to, std::vector<token>& out) const {
+    while (from < to) {
+        size_t end = std::min(next_boundary(s, from), to);
+        out.push_back({from, end - from, hash_bytes(s.data() + from, end - from)});
+        from = end;
+    }
+}
+
+bool text_diff::same(int i, int j) const {
+    const token& x = ta[i];
+    const token& y = tb[j];
+    return x.hash == y.hash && x.len == y.len && std::memcmp(a.data() + x.off, b.data() + y.off, x.len) == 0;
+}
+
+void text_diff::solve(int a0, int a1, int b0, int b1) {
+    while (a0 < a1 && b0 < b1 && same(a0, b0)) { ++a0; ++b0; }
+    while (a0 < a1 && b0 < b1 && same(a1 - 1, b1 - 1)) { --a1; --b1; }
+    int x, y;
+    if (a0 < a1 && b0 < b1 && bisect(a0, a1, b0, b1, x, y)
+        && !(x == a0 && y == b0) && !(x == a1 && y == b1)) {
+        solve(a0, x, b0, y);
+        solve(x, a1, y, b1);
+        return;
+    }
+    std::fill(del.begin() + a0, del.begin() + a1, 1);
+    std::fill(ins.begin() + b0, ins.begin() + b1, 1);
+}
+
+// Runs the forward and reverse searches towards each other until their
+// furthest-reaching paths overlap; (x_out, y_out) is where the forward path
+// stands at that point. False when the edit cost passes max_cost.
+bool text_diff::bisect(int a0, int a1, int b0, int b1, int& x_out, int& y_out) {
+    const int n = a1 - a0, m = b1 - b0;
+    const int max_d = std::min((n + m + 1) / 2, max_cost);
+    const int off = max_d + 1;
+    const int len = 2 * off + 1;
+    vf.assign(len, -1);
+    vb.assign(len, -1);
+    vf[off + 1] = 0;
+    vb[off + 1] = 0;
+    const int delta = n - m;
+    const bool front = (delta & 1) != 0;
+    int k1_lo = 0, k1_hi = 0, k2_lo = 0, k2_hi = 0;
+    for (int d = 0; d < max_d; ++d) {
+        for (int k1 = -d + k1_lo; k1 <= d - k1_hi; k1 += 2) {
+            int i1 = off + k1;
+            int x1 = (k1 == -d || (k1 != d && vf[i1 - 1] < vf[i1 + 1])) ? vf[i1 + 1] : vf[i1 - 1] + 1;
+            int y1 = x1 - k1;
+            while (x1 < n && y1 < m && same(a0 + x1, b0 + y1)) { ++x1; ++y1; }
+            vf[i1] = x1;
+            if (x1 > n) k1_hi += 2;
+            else if (y1 > m) k1_lo += 2;
+            else if (front) {
+                int i2 = off + delta - k1;
+                if (i2 >= 0 && i2 < len && vb[i2] != -1 && x1 >= n - vb[i2]) {
+                    x_out = a0 + x1;
+                    y_out = b0 + y1;
+                    return true;
+                }
+            }
+        }
+        for (int k2 = -d + k2_lo; k2 <= d - k2_hi; k2 += 2) {
+            int i2 = off + k2;
+            int x2 = (k2 == -d || (k2 != d && vb[i2 - 1] < vb[i2 + 1])) ? vb[i2 + 1] : vb[i2 - 1] + 1;
+            int y2 = x2 - k2;
+            while (x2 < n && y2 < m && same(a1 - 1 - x2, b1 - 1 - y2)) { ++x2; ++y2; }
+            vb[i2] = x2;
+            if (x2 > n) k2_hi += 2;
+            else if (y2 > m) k2_lo += 2;
+            else if (!front) {
+                int i1 = off + delta - k2;
+                if (i1 >= 0 && i1 < len && vf[i1] != -1) {
+                    int x1 = vf[i1];
+                    int y1 = x1 - (i1 - off);
+                    if (x1 >= n - x2) {
+                        x_out = a0 + x1;
+                        y_out = b0 + y1;
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Folds the per-token marks into byte ranges, one hunk per run of changes.
+void text_diff::collect() {
+    size_t i = 0, j = 0;
+    while (i < ta.size() || j < tb.size()) {
+        if (i < ta.size() && j < tb.size() && !del[i] && !ins[j]) { ++i; ++j; continue; }
+        hunk h{i < ta.size() ? ta[i].off : a_hi, 0, j < tb.size() ? tb[j].off : b_hi, 0, 0, 0};
+        while (i < ta.size() && del[i]) { h.a_len += ta[i].len; ++h.deleted; ++i; }
+        while (j < tb.size() && ins[j]) { h.b_len += tb[j].len; ++h.inserted; ++j; }
+        changes.push_back(h);
+    }
+}
+
+size_t text_diff::deleted() const {
+    size_t n = 0;
+    for (const hunk& h : changes) n += h.deleted;
+    return n;
+}
+
+size_t text_diff::inserted() const {
+    size_t n = 0;
+    for (const hunk& h : changes) n += h.inserted;
+    return n;
+}
+
+// Unchanged a[from, to): kept whole when short, otherwise only ctx tokens
+// next to the neighbouring changes survive, with "..." for the gap.
+void text_diff::render_same(std::string& out, size_t from, size_t to, bool first, bool last, int ctx) const {
+    if (from >= to) return;
+    size_t keep_head = from, keep_tail = to;
+    if (!first) for (int k = 0; k < ctx && keep_head < to; ++k) keep_head = next_boundary(a, keep_head);
+    if (!last) for (int k = 0; k < ctx && keep_tail > from; ++k) keep_tail = prev_boundary(a, keep_tail);
+    if (keep_head >= keep_tail) {
+        render_text(out, a, from, to - from, "", "", ' ');
+        return;
+    }
+    render_text(out, a, from, keep_head - from, "", "", ' ');
+    out += by_line ? "  ...\n" : "... ";
+    render_text(out, a, keep_tail, to - keep_tail, "", "", ' ');
+}
+
+void text_diff::render_text(std::string& out, const std::string& s, size_t off, size_t len, const char* pre, const char* post, char mark) const {
+    if (!len) return;
+    if (!by_line) {
+        out += pre;
+        out.append(s, off, len);
+        out += post;
+        return;
+    }
+    size_t end = off + len;
+    while (off < end) {
+        size_t nl = s.find('\n', off);
+        size_t stop = nl == std::string::npos || nl >= end ? end : nl + 1;
+        out += mark;
+        out += ' ';
+        out.append(s, off, stop - off);
+        if (s[stop - 1] != '\n') out += '\n';
+        off = stop;
+    }
+}
+
+void text_diff::render(std::string& out, int ctx) const {
+    size_t pos = 0;
+    for (size_t k = 0; k < changes.size(); ++k) {
+        const hunk& h = changes[k];
+        render_same(out, pos, h.a_off, k == 0, false, ctx);
+        render_text(out, a, h.a_off, h.a_len, "[-", "-]", '-');
+        render_text(out, b, h.b_off, h.b_len, "{+", "+}", '+');
+        pos = h.a_off + h.a_len;
+    }
+    if (changes.empty()) return;
+    render_same(out, pos, a.size(), false, true, ctx);
+    if (!by_line) out += '\n';
+}
+
+#endif // DIFF_HPP
@@ -0,0 +1,164 @@
+#ifndef EPOCH_HPP
+#define EPOCH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Epoch-based reclamation for structures that are read without locks. A
+// reader wraps its accesses in a guard, which announces the global epoch it
+// started in. A writer first unlinks an object, so no new reader can reach
+// it, and then retires it: retiring stamps the object with the current epoch
+// and advances the epoch, and the object is freed once no reader announces
+// an epoch that old. Guards nest and cost two uncontended atomic stores.
+class epoch_domain {
+public:
+    class guard {
+    public:
+        guard() { global().enter(); }
+        ~guard() { global().leave(); }
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+    };
+
+    static epoch_domain& global();
+
+    template <typename T>
+    void retire(T* p) {
+        retire(p, [](void* q) { delete static_cast<T*>(q); });
+    }
+    void retire(void* p, void (*del)(void*));
+    // Frees every retired object no reader can still hold; returns how many.
+    size_t collect();
+    size_t pending() const;
+
+private:
+    static constexpr int max_readers = 128;
+    static constexpr size_t collect_every = 64;
+
+    struct alignas(64) reader_slot {
+        std::atomic<std::uint64_t> active{0};
+        std::atomic<bool> owned{false};
+        int depth = 0;
+    };
+    struct retired {
+        void* p;
+        void (*del)(void*);
+        std::uint64_t at;
+    };
+    // Hands a thread's slot back when the thread exits.
+    struct slot_lease {
+        reader_slot* slot = nullptr;
+        ~slot_lease() {
+            if (slot) slot->owned.store(false, std::memory_order_release);
+        }
+    };
+
+    epoch_domain() {}
+    ~epoch_domain();
+
+    std::atomic<std::uint64_t> now{1};
+    reader_slot slots[max_readers];
+    mutable std::mutex mu;
+    std::vector<retired> limbo;
+    size_t collect_at = collect_every;
+
+    reader_slot& own_slot();
+    void enter();
+    void leave();
+    std::uint64_t oldest_reader() const;
+};
+
+// Implementation
+epoch_domain& epoch_domain::global() {
+    static epoch_domain d;
+    return d;
+}
+
+epoch_domain::~epoch_domain() {
+    for (const retired& r : limbo) r.del(r.p);
+}
+
+// Slots are claimed on a thread's first guard and kept until it exits; when
+// all of them are taken the thread waits for one to come free.
+epoch_domain::reader_slot& epoch_domain::own_slot() {
+    static thread_local slot_lease lease;
+    while (!lease.slot) {
+        for (reader_slot& s : slots) {
+            bool expected = false;
+            if (s.owned.compare_exchange_strong(expected, true)) {
+                lease.slot = &s;
+                break;
+            }
+        }
+        if (!lease.slot) std::this_thread::yield();
+    }
+    return *lease.slot;
+}
+
+// The epoch is read again after it has been announced: a writer that
+// advanced it in between may already have scanned the slots without seeing
+// this one, so the announcement is retried with the newer value.
+void epoch_domain::enter() {
+    reader_slot& s = own_slot();
+    if (s.depth++ > 0) return;
+    std::uint64_t e = now.load();
+    for (;;) {
+        s.active.store(e);
+        std::uint64_t again = now.load();
+        if (again == e) break;
+        e = again;
+    }
+}
+
+void epoch_domain::leave() {
+    reader_slot& s = own_slot();
+    if (--s.depth == 0) s.active.store(0, std::memory_order_release);
+}
+
+std::uint64_t epoch_domain::oldest_reader() const {
+    std::uint64_t oldest = UINT64_MAX;
+    for (const reader_slot& s : slots) {
+        std::uint64_t e = s.active.load();
+        if (e) oldest = std::min(oldest, e);
+    }
+    return oldest;
+}
+
+void epoch_domain::retire(void* p, void (*del)(void*)) {
+    bool full;
+    {
+        std::lock_guard<std::mutex> hold(mu);
+        limbo.push_back({p, del, now.fetch_add(1)});
+        full = limbo.size() >= collect_at;
+    }
+    if (full) collect();
+}
+
+// A reader that announced an epoch newer than an object's stamp read the
+// epoch after the object was unlinked, so it cannot be holding it. A reader
+// stalled inside a guard holds everything back, so the next collection waits
+// until the backlog has doubled rather than rescanning it on every retire.
+size_t epoch_domain::collect() {
+    std::vector<retired> done;
+    {
+        std::lock_guard<std::mutex> hold(mu);
+        std::uint64_t oldest = oldest_reader();
+        auto keep = std::partition(limbo.begin(), limbo.end(), [oldest](const retired& r) { return r.at >= oldest; });
+        done.assign(keep, limbo.end());
+        limbo.erase(keep, limbo.end());
+        collect_at = std::max(collect_every, 2 * limbo.size());
+    }
+    for (const retired& r : done) r.del(r.p);
+    return done.size();
+}
+
+size_t epoch_domain::pending() const {
+    std::lock_guard<std::mutex> hold(mu);
+    return limbo.size();
+}
+
+#endif // EPOCH_HPP
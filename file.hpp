@@ -4,8 +4,37 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <chrono>
+#include <atomic>
+#include <memory>
 #include "tree_node.hpp"
+#include "epoch.hpp"
 #include "hash_map.hpp"
+#include "checkpoint.hpp"
+#include "node_pool.hpp"
+#include "merge.hpp"
+
+struct storage_stats {
+    long long versions = 0;
+    long long pool_chunks = 0;
+    long long pool_bytes = 0;
+    long long stored_bytes = 0;
+    long long full_bytes = 0;
+    double rebuild_ns = 0;
+};
+
+struct prune_stats {
+    long long versions = 0;
+    long long bytes = 0;
+};
+
+struct merge_report {
+    tree_node* base = nullptr;
+    tree_node* result = nullptr;
+    int applied = 0;
+    bool line_mode = false;
+    std::vector<text_merge::conflict> conflicts;
+};
 
 class file {
     friend class tree_node;
@@ -13,51 +42,282 @@ class file {
 
 private:
     std::string name;
+    // Every version of the file lives in its own pool, so the whole tree is
+    // released chunk by chunk when the file goes away.
+    node_pool<tree_node> pool;
     tree_node* root;
     tree_node* active_version;
     hash_map<int, tree_node*> version_map;
+    // Snapshots ordered by ss_ts. Snapshots are taken in clock order, so
+    // entries are nearly always appended; snapshots are never pruned, so the
+    // pointers stay valid.
+    using ss_entry = std::pair<time_t, tree_node*>;
+    std::vector<ss_entry> ss_index;
+    static bool ss_before(const ss_entry& x, const ss_entry& y) { return x.first < y.first; }
     int total_versions;
+    int kf_every;
+    int handle;
+    // Set while the version tree still lives only in a loaded checkpoint.
+    std::shared_ptr<ckpt_map> ckpt;
+    size_t ckpt_idx;
+
+    // Read side for other threads (see read_shared). published is the active
+    // version as of the last change: a snapshot is handed out as its node,
+    // since snapshots never change and are never pruned, and a draft as a
+    // copy of its rope taken at its last edit. ss_slots maps version ids to
+    // snapshot nodes. Both are replaced, never changed in place, and what
+    // they replace is retired to the epoch domain.
+    struct read_handle {
+        const tree_node* node;
+        rope text;
+    };
+    struct ss_table {
+        int cap;
+        std::unique_ptr<std::atomic<const tree_node*>[]> at;
 
-    void deleteTree(tree_node* node);
+        explicit ss_table(int n);
+    };
+    std::atomic<read_handle*> published{nullptr};
+    std::atomic<ss_table*> ss_slots{nullptr};
+    bool sharing = false;
+
+    void publish();
+    void publish_ss(const tree_node* node);
+    void fault_in();
+    tree_node* spawn(tree_node* parent, const rope& content);
+    void index_ss(tree_node* node, time_t old_ts);
     std::vector<tree_node*> get_vp(int version_id);
 
 public:
     file(const std::string& filename);
+    file(const std::string& filename, std::shared_ptr<ckpt_map> map, size_t idx);
     ~file();
 
-    std::string read() const;
-    void ins(const std::string& content);
-    void upd(const std::string& content);
-    void ss(const std::string& message = "");
+    std::string read();
+    void ins(std::string_view content);
+    void upd(std::string_view content);
+    void ss(std::string_view message = "");
     void rb(int version_id = -1);
-    void history();
+    void history(int limit = -1, int offset = 0);
     tree_node* find_ver(int version_id);
     const std::string& get_name() const;
     void rnm(const std::string& newName);
     void print(const std::vector<tree_node*>& nodes) const;
-    void print_active_version_info() const;
+    void print_active_version_info();
     bool switch_version(int version_id);
+    tree_node* lca(int ver_a, int ver_b);
+    bool merge(int ours, int theirs, merge_report& rep);
+    tree_node* ss_at(time_t t);
+    int prune(int from, int to, std::chrono::steady_clock::time_point deadline, prune_stats& st);
+    void set_kf_every(int k) { kf_every = k; }
+    void collect_stats(storage_stats& st);
+    void save_to(ckpt_writer& w);
+
+    // Lock-free readers, safe on any thread while another one runs the
+    // operations above. read_shared gives the active version's text and pin
+    // a rope that stays readable however the file changes afterwards; the
+    // version_id form only pins snapshots. All are false for a checkpointed
+    // file whose versions have not been loaded yet, and the first two also
+    // until share(true) has been called: keeping the active version
+    // published costs a copy of its piece list on every edit.
+    void share(bool on);
+    bool read_shared(std::string& out) const;
+    bool pin(rope& out) const;
+    bool pin(int version_id, rope& out) const;
 };
 
 using fl = file;
 
 // Constructor & Destructor
 file::file(const std::string& filename)
-    : name(filename), total_versions(1)
+    : name(filename), total_versions(1), kf_every(0), handle(-1), ckpt_idx(0)
 {
-    root = new tree_node(0, "", nullptr);
+    root = pool.make(0, "");
     root->upd_msg("Initial Snapshot");
-    root->ss_ts = std::time(nullptr);
+    root->freeze(0);
+    root->ss_ts = now_ts();
     active_version = root;
     version_map.ins(0, root);
+    ss_index.push_back({root->ss_ts, root});
+    publish_ss(root);
+    publish();
+}
+
+file::file(const std::string& filename, std::shared_ptr<ckpt_map> map, size_t idx)
+    : name(filename), root(nullptr), active_version(nullptr), handle(-1), ckpt(map), ckpt_idx(idx)
+{
+    const ckpt_file& cf = ckpt->file_at(ckpt_idx);
+    total_versions = cf.total_versions;
+    kf_every = cf.kf_every;
 }
 
 file::~file() {
-    delete root;
+    version_map.iterate([this](const int&, tree_node*& node) { pool.destroy(node); });
+    delete published.load(std::memory_order_relaxed);
+    delete ss_slots.load(std::memory_order_relaxed);
 }
 
-void fl::deleteTree(tree_node* node) {
-    delete node;
+file::ss_table::ss_table(int n) : cap(n), at(new std::atomic<const tree_node*>[n]) {
+    for (int i = 0; i < n; ++i) at[i].store(nullptr, std::memory_order_relaxed);
+}
+
+// Called after every change to the active version or to its text; a no-op
+// while the file is not shared.
+void fl::publish() {
+    if (!sharing && !published.load(std::memory_order_relaxed)) return;
+    read_handle* h = nullptr;
+    if (sharing && active_version && active_version->is_ss()) h = new read_handle{active_version, rope()};
+    else if (sharing && active_version) {
+        h = new read_handle{nullptr, active_version->content};
+        h->text.seal();
+    }
+    read_handle* old = published.exchange(h, std::memory_order_acq_rel);
+    if (old) epoch_domain::global().retire(old);
+}
+
+void fl::share(bool on) {
+    sharing = on;
+    publish();
+}
+
+void fl::publish_ss(const tree_node* node) {
+    ss_table* t = ss_slots.load(std::memory_order_relaxed);
+    int id = node->version_id;
+    if (!t || id >= t->cap) {
+        int cap = t ? t->cap : 16;
+        while (cap <= id) cap *= 2;
+        ss_table* bigger = new ss_table(cap);
+        for (int i = 0; t && i < t->cap; ++i) bigger->at[i].store(t->at[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        ss_slots.store(bigger, std::memory_order_release);
+        if (t) epoch_domain::global().retire(t);
+        t = bigger;
+    }
+    t->at[id].store(node, std::memory_order_release);
+}
+
+bool fl::read_shared(std::string& out) const {
+    epoch_domain::guard g;
+    const read_handle* h = published.load(std::memory_order_acquire);
+    if (!h) return false;
+    out = h->node ? h->node->get_content() : h->text.read();
+    return true;
+}
+
+bool fl::pin(rope& out) const {
+    epoch_domain::guard g;
+    const read_handle* h = published.load(std::memory_order_acquire);
+    if (!h) return false;
+    out = h->node ? h->node->get_rope() : h->text;
+    return true;
+}
+
+bool fl::pin(int version_id, rope& out) const {
+    epoch_domain::guard g;
+    const ss_table* t = ss_slots.load(std::memory_order_acquire);
+    const tree_node* node = t && version_id >= 0 && version_id < t->cap ? t->at[version_id].load(std::memory_order_acquire) : nullptr;
+    if (!node) return false;
+    out = node->get_rope();
+    return true;
+}
+
+// Builds the version tree from the checkpoint on first use.
+void fl::fault_in() {
+    if (!ckpt) return;
+    const ckpt_file& cf = ckpt->file_at(ckpt_idx);
+    std::vector<tree_node*> nodes(cf.node_cnt, nullptr);
+    time_t prev_pin = pinned_ts();
+    for (size_t i = 0; i < cf.node_cnt; ++i) {
+        const ckpt_node& cn = ckpt->node_at(cf.node_begin + i);
+        pinned_ts() = static_cast<time_t>(cn.created_ts);
+        tree_node* node = pool.make(cn.version_id);
+        node->message = ckpt->str(cn.msg_off, cn.msg_len);
+        node->last_mod_ts = static_cast<time_t>(cn.last_mod_ts);
+        node->ss_ts = static_cast<time_t>(cn.ss_ts);
+        node->kf_dist = cn.kf_dist;
+        if (cn.kind == CK_LIVE) {
+            node->content = rope(ckpt->str(cn.text_off, cn.text_len));
+        } else if (cn.kind == CK_BLOB) {
+            node->blob = blob_ref(rope(ckpt->str(cn.text_off, cn.text_len)));
+        } else {
+            node->is_delta = true;
+            node->d_pre = cn.d_pre;
+            node->d_suf = cn.d_suf;
+            node->d_mid = ckpt->str(cn.text_off, cn.text_len);
+        }
+        if (cn.parent >= 0) nodes[cn.parent]->add_child(node);
+        nodes[i] = node;
+        version_map.ins(cn.version_id, node);
+    }
+    pinned_ts() = prev_pin;
+    for (tree_node* node : nodes) {
+        if (node->is_ss()) {
+            ss_index.push_back({node->ss_ts, node});
+            publish_ss(node);
+        }
+    }
+    std::stable_sort(ss_index.begin(), ss_index.end(), ss_before);
+    root = nodes.empty() ? nullptr : nodes[0];
+    active_version = cf.active >= 0 ? nodes[cf.active] : root;
+    ckpt.reset();
+    publish();
+}
+
+// Emits the tree in preorder so parents precede their children.
+void fl::save_to(ckpt_writer& w) {
+    fault_in();
+    ckpt_file cf;
+    std::memset(&cf, 0, sizeof(cf));
+    cf.name_len = static_cast<std::uint32_t>(name.size());
+    cf.name_off = w.add_str(name);
+    cf.node_begin = w.node_cnt();
+    cf.active = -1;
+    cf.total_versions = total_versions;
+    cf.kf_every = kf_every;
+
+    std::vector<std::pair<tree_node*, int>> stack;
+    if (root) stack.push_back({root, -1});
+    int idx = 0;
+    while (!stack.empty()) {
+        tree_node* node = stack.back().first;
+        int par = stack.back().second;
+        stack.pop_back();
+
+        ckpt_node cn;
+        std::memset(&cn, 0, sizeof(cn));
+        cn.version_id = node->version_id;
+        cn.parent = par;
+        cn.created_ts = node->created_ts;
+        cn.last_mod_ts = node->last_mod_ts;
+        cn.ss_ts = node->ss_ts;
+        cn.msg_len = static_cast<std::uint32_t>(node->message.size());
+        cn.msg_off = w.add_str(node->message);
+        cn.kf_dist = node->kf_dist;
+        if (node->is_delta) {
+            cn.kind = CK_DELTA;
+            cn.d_pre = node->d_pre;
+            cn.d_suf = node->d_suf;
+            cn.text_len = node->d_mid.size();
+            cn.text_off = w.add_str(node->d_mid);
+        } else if (node->blob) {
+            cn.kind = CK_BLOB;
+            cn.text_len = node->blob.size();
+            cn.text_off = w.add_blob(node->blob.id(), node->blob.data());
+        } else {
+            cn.kind = CK_LIVE;
+            std::string text = node->content.read();
+            cn.text_len = text.size();
+            cn.text_off = w.add_str(text);
+        }
+        if (node == active_version) cf.active = idx;
+        w.add_node(cn);
+
+        size_t first = stack.size();
+        for (tree_node* c = node->first_child; c; c = c->next_sibling) stack.push_back({c, idx});
+        std::reverse(stack.begin() + first, stack.end());
+        ++idx;
+    }
+    cf.node_cnt = static_cast<std::uint32_t>(idx);
+    w.add_file(cf);
 }
 
 // File operations
@@ -66,92 +326,124 @@ void fl::rnm(const std::string& newName) {
     name = newName;
 }
 
-std::string fl::read() const {
+std::string fl::read() {
+    fault_in();
     if (active_version)
-        return active_version->content;
+        return active_version->get_content();
     return "";
 }
 
-void fl::ins(const std::string& content) {
+void fl::ins(std::string_view content) {
+    fault_in();
     if (!active_version) {
-        std::cout << "No version selected as active." << std::endl;
+        console() << "No version selected as active." << std::endl;
         return;
     }
     if (active_version->is_ss()) {
-        tree_node* new_node = new tree_node(total_versions, active_version->content, active_version);
-        new_node->upd_cont(new_node->content + content);
-        active_version->add_child(new_node);
-        active_version = new_node;
-        version_map.ins(total_versions, new_node);
-        ++total_versions;
+        spawn(active_version, active_version->get_rope())->app_cont(content);
     } else {
-        active_version->upd_cont(active_version->content + content);
+        active_version->app_cont(content);
     }
+    publish();
 }
 
-void fl::upd(const std::string& content) {
+void fl::upd(std::string_view content) {
+    fault_in();
     if (!active_version) {
-        std::cout << "No version selected as active." << std::endl;
+        console() << "No version selected as active." << std::endl;
         return;
     }
     if (active_version->is_ss()) {
-        tree_node* new_node = new tree_node(total_versions, content, active_version);
-        active_version->add_child(new_node);
-        active_version = new_node;
-        version_map.ins(total_versions, new_node);
-        ++total_versions;
+        spawn(active_version, rope(content));
     } else {
         active_version->upd_cont(content);
     }
+    publish();
+}
+
+// New editable version under a snapshot; it becomes the active version.
+tree_node* fl::spawn(tree_node* parent, const rope& content) {
+    tree_node* node = pool.make(total_versions, content, parent);
+    parent->add_child(node);
+    active_version = node;
+    version_map.ins(total_versions, node);
+    ++total_versions;
+    return node;
 }
 
-void fl::ss(const std::string& message) {
+void fl::ss(std::string_view message) {
+    fault_in();
     if (!active_version) {
-        std::cout << "No version selected as active." << std::endl;
+        console() << "No version selected as active." << std::endl;
         return;
     }
+    time_t old_ts = active_version->ss_ts;
+    if (!active_version->is_ss()) active_version->freeze(kf_every);
     active_version->upd_msg(message);
-    active_version->ss_ts = std::time(nullptr);
+    active_version->set_ss_ts(now_ts());
+    index_ss(active_version, old_ts);
+    if (!old_ts) {
+        publish_ss(active_version);
+        publish();
+    }
+}
+
+// Files node under its new ss_ts, dropping the entry for old_ts when the node
+// was already a snapshot.
+void fl::index_ss(tree_node* node, time_t old_ts) {
+    if (old_ts) {
+        auto it = std::lower_bound(ss_index.begin(), ss_index.end(), ss_entry(old_ts, nullptr), ss_before);
+        while (it != ss_index.end() && it->first == old_ts && it->second != node) ++it;
+        if (it != ss_index.end() && it->second == node) ss_index.erase(it);
+    }
+    ss_entry entry(node->ss_ts, node);
+    if (ss_index.empty() || ss_index.back().first <= entry.first) ss_index.push_back(entry);
+    else ss_index.insert(std::upper_bound(ss_index.begin(), ss_index.end(), entry, ss_before), entry);
+}
+
+// Latest snapshot taken at or before t, or nullptr if there is none.
+tree_node* fl::ss_at(time_t t) {
+    fault_in();
+    auto it = std::upper_bound(ss_index.begin(), ss_index.end(), ss_entry(t, nullptr), ss_before);
+    return it == ss_index.begin() ? nullptr : std::prev(it)->second;
 }
 
 void fl::rb(int ver_id) {
+    fault_in();
     if (ver_id == -1) {
         if (active_version && active_version->parent) {
             active_version = active_version->parent;
+            publish();
         } else {
-            std::cout << "No parent version to rb to." << std::endl;
+            console() << "No parent version to rb to." << std::endl;
         }
     } else {
         tree_node* target = nullptr;
         if (version_map.find(ver_id, target) && target != nullptr) {
-            tree_node* cur = active_version;
-            bool ancestor_found = false;
-            while (cur != nullptr) {
-                if (cur == target) {
-                    ancestor_found = true;
-                    break;
-                }
-                cur = cur->parent;
-            }
-            if (ancestor_found) {
+            if (target->is_ancestor_of(active_version)) {
                 active_version = target;
+                publish();
             } else {
-                std::cout << "Version " << ver_id << " is not an ancestor of current version. Rollback denied." << std::endl;
+                console() << "Version " << ver_id << " is not an ancestor of current version. Rollback denied." << std::endl;
             }
         } else {
-            std::cout << "Version ID: " << ver_id << " not found.\n";
+            console() << "Version ID: " << ver_id << " not found.\n";
         }
     }
 }
 
-void fl::history() {
+// Follows the snapshot skip links from the active version: skips the offset
+// most recent snapshots, keeps up to limit (all when limit < 0) and prints
+// them oldest first.
+void fl::history(int limit, int offset) {
+    fault_in();
     if (!active_version) return;
-    std::vector<tree_node*> path = get_vp(active_version->version_id);
+    tree_node* cur = active_version->is_ss() ? active_version : active_version->ss_up;
+    for (; cur && offset > 0; --offset) cur = cur->ss_up;
     std::vector<tree_node*> snapshots;
-    for (auto node : path) {
-        if (node->is_ss())
-            snapshots.push_back(node);
-    }
+    for (; cur && (limit < 0 || (int)snapshots.size() < limit); cur = cur->ss_up)
+        snapshots.push_back(cur);
+    std::reverse(snapshots.begin(), snapshots.end());
     print(snapshots);
 }
 
@@ -160,10 +452,11 @@ const std::string& fl::get_name() const {
 }
 
 tree_node* fl::find_ver(int version_id) {
+    fault_in();
     tree_node* node = nullptr;
     if (version_map.find(version_id, node))
         return node;
-    std::cout << "NOT FOUND" << std::endl;
+    console() << "NOT FOUND" << std::endl;
     return nullptr;
 }
 
@@ -177,33 +470,116 @@ std::vector<tree_node*> fl::get_vp(int version_id) {
 void fl::print(const std::vector<tree_node*>& nodes) const {
     for (tree_node* node : nodes) {
         if (node) {
-            std::cout << "Version ID: " << node->version_id
+            char when[26];
+            console() << "Version ID: " << node->version_id
                       << " | Message: " << node->message
-                      << " | Updated: " << std::ctime(&node->created_ts) << std::endl;
+                      << " | Updated: " << ctime_r(&node->created_ts, when) << std::endl;
         }
     }
 }
 
-void fl::print_active_version_info() const {
+void fl::print_active_version_info() {
+    fault_in();
     if (!active_version) {
-        std::cout << "No active version selected." << std::endl;
+        console() << "No active version selected." << std::endl;
         return;
     }
-    std::cout << "Active Version ID: " << active_version->version_id << std::endl;
+    console() << "Active Version ID: " << active_version->version_id << std::endl;
     if (!active_version->message.empty()) {
-        std::cout << "Message: " << active_version->message << std::endl;
+        console() << "Message: " << active_version->message << std::endl;
     }
-    std::cout << "Created at: " << std::ctime(&active_version->created_ts);
+    char when[26];
+    console() << "Created at: " << ctime_r(&active_version->created_ts, when);
 }
 
 bool fl::switch_version(int version_id) {
+    fault_in();
     tree_node* target = nullptr;
     if (!version_map.find(version_id, target) || !target) {
-        std::cout << "Version " << version_id << " not found." << std::endl;
+        console() << "Version " << version_id << " not found." << std::endl;
         return false;
     }
     active_version = target;
+    publish();
     return true;
 }
 
+// Lowest common ancestor of two versions, or nullptr if either is missing.
+tree_node* fl::lca(int ver_a, int ver_b) {
+    fault_in();
+    tree_node* a = nullptr;
+    tree_node* b = nullptr;
+    if (!version_map.find(ver_a, a) || !version_map.find(ver_b, b)) return nullptr;
+    return tree_node::lca(a, b);
+}
+
+// Three-way merge of theirs into ours against their lowest common ancestor.
+// The result is a new active version under ours, which must be a snapshot
+// like every other parent.
+bool fl::merge(int ours, int theirs, merge_report& rep) {
+    fault_in();
+    tree_node* a = nullptr;
+    tree_node* b = nullptr;
+    if (!version_map.find(ours, a) || !version_map.find(theirs, b)) {
+        console() << "Version " << ours << " or " << theirs << " not found." << std::endl;
+        return false;
+    }
+    if (!a->is_ss()) {
+        console() << "Version " << ours << " is not a snapshot. Snapshot it before merging into it." << std::endl;
+        return false;
+    }
+    rep.base = tree_node::lca(a, b);
+    std::string text_base = rep.base->get_content();
+    std::string text_a = a->get_content(), text_b = b->get_content();
+    text_merge m(text_base, text_a, text_b,
+                 "V" + std::to_string(ours), "V" + std::to_string(theirs));
+    rep.applied = m.applied();
+    rep.line_mode = m.line_mode();
+    rep.conflicts = m.conflicts();
+    rep.result = spawn(a, rope(m.text()));
+    publish();
+    return true;
+}
+
+// Drops drafts (unsnapshotted versions other than the active one) with ids
+// in [from, to). Drafts are always leaves and every ancestor of a snapshot
+// is a snapshot, so what stays is exactly the snapshots and the active path.
+// The clock is only read every 64 ids; returns the first id not yet visited,
+// which is below to when the deadline cut the pass short.
+int fl::prune(int from, int to, std::chrono::steady_clock::time_point deadline, prune_stats& st) {
+    fault_in();
+    to = std::min(to, total_versions);
+    int id = std::max(from, 0);
+    for (; id < to; ++id) {
+        if ((id & 63) == 0 && id > from && std::chrono::steady_clock::now() >= deadline) break;
+        tree_node* node = nullptr;
+        if (!version_map.find(id, node) || node->is_ss() || node == active_version || node->first_child) continue;
+        st.versions++;
+        st.bytes += node->stored_bytes();
+        node->parent->rm_child(node);
+        version_map.rm(id);
+        pool.destroy(node);
+    }
+    if (id >= to) version_map.compact();
+    return id;
+}
+
+// Full-copy bytes are what the same versions would cost if every node held
+// its whole document, as they do when kf_every is 0.
+void fl::collect_stats(storage_stats& st) {
+    fault_in();
+    st.pool_chunks += pool.chunk_cnt();
+    st.pool_bytes += pool.reserved_bytes();
+    version_map.iterate([&st](const int&, tree_node*& node) {
+        auto start = std::chrono::steady_clock::now();
+        std::string text = node->get_content();
+        auto stop = std::chrono::steady_clock::now();
+        st.rebuild_ns += std::chrono::duration<double, std::nano>(stop - start).count();
+        st.versions++;
+        st.stored_bytes += node->stored_bytes();
+        st.full_bytes += node->stored_bytes() - node->content.bytes() - node->blob.bytes()
+                       - node->d_mid.capacity() + text.size();
+    });
+}
+
 #endif // FILE_HPP
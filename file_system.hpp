@@ -2,58 +2,205 @@
 #define FILE_SYSTEM_HPP
 
 #include <string>
+#include <string_view>
 #include <iostream>
-#include <stack>
+#include <chrono>
+#include <fstream>
+#include <utility>
 #include "file.hpp"
-#include "hash_map.hpp"
+#include "shard_map.hpp"
 #include "heap.hpp"
+#include "lru.hpp"
+#include "cmd_history.hpp"
+#include "diff.hpp"
+#include "search_index.hpp"
+
+struct gc_cursor {
+    int handle = 0;
+    int next_id = 0;
+};
+
+// What a command run by the parallel batch engine would have done to state
+// shared by all files. While cmd_effects::current() is set on a thread,
+// file_system captures the command's output and records its reminders,
+// RECENT touches, BIGGEST updates and search index additions here instead of
+// applying them; the engine then applies everything in input order
+// (file_system::apply), so the result matches a sequential run.
+struct cmd_effects {
+    std::string out;
+    std::vector<size_t> reminders;
+    std::vector<int> touched;
+    std::vector<std::pair<int, int>> sizes;
+    std::string index_text;
+    std::vector<std::pair<std::uint64_t, size_t>> index_docs;
+
+    void clear() {
+        out.clear();
+        reminders.clear();
+        touched.clear();
+        sizes.clear();
+        index_text.clear();
+        index_docs.clear();
+    }
+
+    static cmd_effects*& current() {
+        static thread_local cmd_effects* fx = nullptr;
+        return fx;
+    }
+};
 
 class file_system {
 private:
     hp biggest_trees_h;
-    std::stack<std::string> recent_files_s;
+    std::vector<fl*> by_handle;
+    lru_list recent_lru;
     int op_count = 0;
+    int kf_every = 0;
+    // Incremental GC: the sweep visits files in handle order and versions in
+    // id order, so (handle, next_id) is enough to resume it. gc_every > 0
+    // runs a gc_budget_ms slice after every gc_every mutating commands.
+    gc_cursor gc_at;
+    prune_stats gc_sweep;
+    int gc_every = 0;
+    int gc_budget_ms = 2;
+    int gc_ops = 0;
+    bool gc_complete = false;
+    // Files loaded from a checkpoint join the search index on the first
+    // SEARCH that covers them; indexed[handle] records which ones have.
+    // New versions of indexed files wait in index_due[handle] until then
+    // too, so editing never pays for the whole text of a version.
+    trigram_index search_idx;
+    std::vector<char> indexed;
+    std::vector<std::vector<int>> index_due;
+    // How far into the journal the last loaded checkpoint reaches.
+    long long ckpt_jrn_records = 0;
+    std::uint64_t ckpt_jrn_sum = 0;
 
     std::string gen_untitled_name() {
         return "untitled" + std::to_string(++untitled_cnt);
     }
 
-    void remind_snapshot() {
-        if (++op_count % 10 == 0) {
-            std::cout << "Reminder: Consider taking a snapshot after important changes." << std::endl;
-        }
+    // Files are identified by a dense integer handle inside the indexes, so
+    // renames never touch them.
+    void register_file(fl* f) {
+        f->handle = static_cast<int>(by_handle.size());
+        by_handle.push_back(f);
+        indexed.push_back(!f->ckpt);
+        index_due.emplace_back();
+        biggest_trees_h.ins(f->handle, f->total_versions);
     }
 
-    void print_node(tree_node* node, const std::string& prefix = "", bool is_last = true, bool art_mode = false) {
-        if (!node) return;
+    // Last bytes of the active draft, which text appended to it can extend
+    // into new trigrams.
+    std::string index_edge(fl* f) {
+        if (!indexed[f->handle] || f->ckpt || !f->active_version || f->active_version->is_ss()) return "";
+        return f->active_version->content.tail(2);
+    }
 
-        std::cout << prefix << (is_last ? "└─ " : "├─ ") << "V" << node->version_id;
-        if (!node->message.empty()) std::cout << " : \"" << node->message << "\"";
-        std::cout << std::endl;
+    // Brings the search index up to date after an edit of f's active
+    // version: a new version is queued to be indexed whole by the next
+    // SEARCH, an edited draft is indexed by the text that was added to it.
+    // (Text added to a draft that is still queued is listed twice, which
+    // the index tolerates.)
+    void index_change(fl* f, int versions_before, std::string_view added) {
+        if (!indexed[f->handle] || !f->active_version) return;
+        tree_node* v = f->active_version;
+        if (f->total_versions != versions_before) {
+            index_due[f->handle].push_back(v->version_id);
+            return;
+        }
+        std::uint64_t id = trigram_index::doc_id(f->handle, v->version_id);
+        if (cmd_effects* fx = cmd_effects::current()) {
+            fx->index_text.append(added);
+            fx->index_docs.emplace_back(id, added.size());
+        }
+        else search_idx.add(id, added.data(), added.size());
+    }
 
-        for (size_t i = 0; i < node->children.size(); ++i) {
-            print_node(node->children[i], prefix + (is_last ? "    " : "│   "), i == node->children.size() - 1, art_mode);
+    // Indexes every version of a file loaded from a checkpoint, or the
+    // queued new versions of any other file; versions pruned while queued
+    // are passed over.
+    void ensure_indexed(fl* f) {
+        int h = f->handle;
+        std::vector<int>& due = index_due[h];
+        if (indexed[h]) {
+            for (int ver : due) {
+                tree_node* node = nullptr;
+                if (f->version_map.find(ver, node)) search_idx.add(trigram_index::doc_id(h, ver), node->get_content());
+            }
+            std::vector<int>().swap(due);
+            return;
         }
+        f->fault_in();
+        trigram_index& idx = search_idx;
+        f->version_map.iterate([&idx, h](const int& ver, tree_node*& node) {
+            idx.add(trigram_index::doc_id(h, ver), node->get_content());
+        });
+        std::vector<int>().swap(due);
+        indexed[h] = 1;
+    }
+
+    void remind_snapshot() {
+        if (cmd_effects* fx = cmd_effects::current()) fx->reminders.push_back(fx->out.size());
+        else if (++op_count % 10 == 0) console() << reminder << std::endl;
+    }
+
+    // Keeps the BIGGEST heap in step with a file's version count.
+    void resized(fl* file) {
+        if (cmd_effects* fx = cmd_effects::current()) fx->sizes.emplace_back(file->handle, file->total_versions);
+        else biggest_trees_h.upd(file->handle, file->total_versions);
+    }
+
+    // One-line rendering of a conflict side for the merge report.
+    static std::string clip(const std::string& s, size_t max_len = 60) {
+        std::string out = "\"";
+        for (size_t i = 0; i < s.size() && i < max_len; ++i) out += s[i] == '\n' ? std::string("\\n") : std::string(1, s[i]);
+        out += s.size() > max_len ? "\"..." : "\"";
+        return out;
+    }
+
+    // Hidden children are summarised as "[+n]" when the depth limit cuts them.
+    void print_node(tree_node* node, int max_depth) {
+        render_tree(console(), node, max_depth, [](std::string& out, tree_node* n, const std::string& prefix, bool is_last, bool expanded) {
+            out += prefix;
+            out += is_last ? "└─ V" : "├─ V";
+            out += std::to_string(n->version_id);
+            if (!n->message.empty()) {
+                out += " : \"";
+                out += n->message;
+                out += "\"";
+            }
+            if (n->first_child && !expanded) {
+                out += " [+";
+                out += std::to_string(n->child_cnt());
+                out += "]";
+            }
+            out += '\n';
+        });
     }
 
 public:
+    static constexpr const char* reminder = "Reminder: Consider taking a snapshot after important changes.";
     int untitled_cnt = 0;
-    hash_map<std::string, fl*> files_map;
-    std::stack<std::string> command_history;
+    shard_map<std::string, fl*> files_map;
+    cmd_history command_history;
 
     file_system() {}
-    ~file_system() {}
+    ~file_system() {
+        for (fl* f : by_handle) delete f;
+    }
 
     std::string create_file(const std::string& filename) {
         fl* existing_file = nullptr;
         if (files_map.find(filename, existing_file)) {
-            std::cout << "File '" << filename << "' already exists." << std::endl;
+            console() << "File '" << filename << "' already exists." << std::endl;
             return "";
         }
         fl* new_file = new fl(filename);
+        new_file->set_kf_every(kf_every);
         files_map.ins(filename, new_file);
-        biggest_trees_h.ins(filename, new_file->total_versions);
-        accessed_file(filename);
+        register_file(new_file);
+        accessed_file(new_file);
         remind_snapshot();
         return filename;
     }
@@ -66,146 +213,533 @@ public:
     bool rnm_file(const std::string& old_n, const std::string& new_n) {
         fl* file = nullptr;
         if (!files_map.find(old_n, file)) {
-            std::cout << "File '" << old_n << "' not found." << std::endl;
+            console() << "File '" << old_n << "' not found." << std::endl;
             return false;
         }
         if (files_map.find(new_n, file)) {
-            std::cout << "File '" << new_n << "' already exists." << std::endl;
+            console() << "File '" << new_n << "' already exists." << std::endl;
             return false;
         }
-        files_map.rm(old_n);
+        if (!files_map.rename(old_n, new_n)) return false;
         file->rnm(new_n);
-        files_map.ins(new_n, file);
-        biggest_trees_h.rm(old_n);
-        biggest_trees_h.ins(new_n, file->total_versions);
-        std::cout << "File renamed from '" << old_n << "' to '" << new_n << "'" << std::endl;
+        console() << "File renamed from '" << old_n << "' to '" << new_n << "'" << std::endl;
         remind_snapshot();
         return true;
     }
 
-    void read_file(const std::string& filename) {
+    void read_file(std::string_view filename) {
         fl* file = nullptr;
         if (!files_map.find(filename, file)) {
-            std::cout << "File '" << filename << "' not found." << std::endl;
+            console() << "File '" << filename << "' not found." << std::endl;
             return;
         }
-        std::cout << file->read() << std::endl;
-        accessed_file(filename);
+        console() << file->read() << std::endl;
+        accessed_file(file);
         remind_snapshot();
     }
 
-    void insert_into_file(const std::string& filename, const std::string& content) {
+    void insert_into_file(std::string_view filename, std::string_view content) {
         fl* file = nullptr;
         if (!files_map.find(filename, file)) {
-            std::cout << "File '" << filename << "' not found." << std::endl;
+            console() << "File '" << filename << "' not found." << std::endl;
             return;
         }
+        int before = file->total_versions;
+        std::string edge = index_edge(file);
         file->ins(content);
-        biggest_trees_h.upd(filename, file->total_versions);
-        accessed_file(filename);
+        index_change(file, before, edge.append(content));
+        resized(file);
+        accessed_file(file);
         remind_snapshot();
     }
 
-    void update_file(const std::string& filename, const std::string& content) {
+    void update_file(std::string_view filename, std::string_view content) {
         fl* file = nullptr;
         if (!files_map.find(filename, file)) {
-            std::cout << "File '" << filename << "' not found." << std::endl;
+            console() << "File '" << filename << "' not found." << std::endl;
             return;
         }
+        int before = file->total_versions;
         file->upd(content);
-        biggest_trees_h.upd(filename, file->total_versions);
-        accessed_file(filename);
+        index_change(file, before, content);
+        resized(file);
+        accessed_file(file);
         remind_snapshot();
     }
 
-    void snapshot_file(const std::string& filename, const std::string& message) {
+    void snapshot_file(std::string_view filename, std::string_view message) {
         fl* file = nullptr;
         if (!files_map.find(filename, file)) {
-            std::cout << "File '" << filename << "' not found." << std::endl;
+            console() << "File '" << filename << "' not found." << std::endl;
             return;
         }
         file->ss(message);
-        biggest_trees_h.upd(filename, file->total_versions);
-        accessed_file(filename);
+        resized(file);
+        accessed_file(file);
         remind_snapshot();
     }
 
-    void rb_file(const std::string& filename, int ver_id = -1) {
+    void rb_file(std::string_view filename, int ver_id = -1) {
         fl* file = nullptr;
         if (!files_map.find(filename, file)) {
-            std::cout << "File '" << filename << "' not found." << std::endl;
+            console() << "File '" << filename << "' not found." << std::endl;
             return;
         }
         file->rb(ver_id);
-        accessed_file(filename);
+        accessed_file(file);
         remind_snapshot();
     }
 
-    void show_history(const std::string& filename) {
+    void show_history(std::string_view filename, int limit = -1, int offset = 0) {
         fl* file = nullptr;
         if (!files_map.find(filename, file)) {
-            std::cout << "File '" << filename << "' not found." << std::endl;
+            console() << "File '" << filename << "' not found." << std::endl;
             return;
         }
-        file->history();
+        file->history(limit, offset);
         remind_snapshot();
     }
 
     void recent_files(int num) {
         if (num <= 0) return;
-        std::stack<std::string> temp_s = recent_files_s;
-        int count = 0;
-        while (!temp_s.empty() && count < num) {
-            std::cout << temp_s.top() << std::endl;
-            temp_s.pop();
-            ++count;
-        }
+        recent_lru.recent(num, [this](int h) { console() << by_handle[h]->get_name() << std::endl; });
         remind_snapshot();
     }
 
     void biggest_trees(int num) {
-        biggest_trees_h.print_top(num);
+        biggest_trees_h.print_top(console(), num, [this](int h) -> const std::string& { return by_handle[h]->get_name(); });
         remind_snapshot();
     }
 
-    void accessed_file(const std::string& filename) {
-        recent_files_s.push(filename);
+    // Names and version counts of the num files with the largest trees.
+    std::vector<std::pair<std::string, int>> biggest(int num) const {
+        std::vector<std::pair<std::string, int>> out;
+        for (const auto& e : biggest_trees_h.top(num)) {
+            out.push_back({by_handle[e.first]->get_name(), e.second});
+        }
+        return out;
+    }
+
+    // Keyed by handle, so a renamed file keeps its place and shows its new name.
+    void accessed_file(fl* file) {
+        if (cmd_effects* fx = cmd_effects::current()) fx->touched.push_back(file->handle);
+        else recent_lru.touch(file->handle);
     }
 
-    void show_command_history() {
-        std::stack<std::string> temp = command_history;
-        while (!temp.empty()) {
-            std::cout << temp.top() << std::endl;
-            temp.pop();
+    // Applies what a command recorded while it ran on a worker and writes its
+    // output to os, with a reminder at each point where a sequential run
+    // would have printed one.
+    void apply(const cmd_effects& fx, std::ostream& os) {
+        for (const auto& sz : fx.sizes) biggest_trees_h.upd(sz.first, sz.second);
+        for (int h : fx.touched) recent_lru.touch(h);
+        size_t pos = 0;
+        for (const auto& doc : fx.index_docs) {
+            search_idx.add(doc.first, fx.index_text.data() + pos, doc.second);
+            pos += doc.second;
+        }
+        pos = 0;
+        for (size_t at : fx.reminders) {
+            if (++op_count % 10 != 0) continue;
+            os.write(fx.out.data() + pos, at - pos);
+            os << reminder << '\n';
+            pos = at;
         }
+        os.write(fx.out.data() + pos, fx.out.size() - pos);
+    }
+
+    // Newest first; limit < 0 shows everything.
+    void show_command_history(long long limit = -1, long long offset = 0) {
+        command_history.visit(limit, offset, [](const std::string& cmd) { console() << cmd << std::endl; });
     }
 
-    void print_version_tree(const std::string& filename, bool use_art = false) {
+    // Node to draw a TREE from: the root when version_id < 0. Reports and
+    // returns nullptr when the file or version is missing.
+    tree_node* tree_top(std::string_view filename, int version_id = -1) {
         fl* file_ptr = nullptr;
         if (!files_map.find(filename, file_ptr) || !file_ptr) {
-            std::cout << "File '" << filename << "' not found.\n";
-            return;
+            console() << "File '" << filename << "' not found.\n";
+            return nullptr;
+        }
+        file_ptr->fault_in();
+        if (version_id < 0) return file_ptr->root;
+        tree_node* node = nullptr;
+        if (!file_ptr->version_map.find(version_id, node) || !node) {
+            console() << "Version " << version_id << " not found." << std::endl;
+            return nullptr;
         }
-        print_node(file_ptr->root, "", true, use_art);
+        return node;
+    }
+
+    void print_version_tree(std::string_view filename, int version_id = -1, int max_depth = -1) {
+        tree_node* top = tree_top(filename, version_id);
+        if (top) print_node(top, max_depth);
     }
 
-    void switch_version(const std::string& filename, int version_id) {
+    void switch_version(std::string_view filename, int version_id) {
         fl* file = nullptr;
         if (!files_map.find(filename, file)) {
-            std::cout << "File '" << filename << "' not found." << std::endl;
+            console() << "File '" << filename << "' not found." << std::endl;
             return;
         }
         if (file->switch_version(version_id)) {
-            std::cout << "Switched to version " << version_id << " of file '" << filename << "'." << std::endl;
-            accessed_file(filename);
+            console() << "Switched to version " << version_id << " of file '" << filename << "'." << std::endl;
+            accessed_file(file);
             remind_snapshot();
         }
     }
 
-    void show_active_version(const std::string& filename) {
+    // k <= 1 keeps a full copy in every version; otherwise snapshots store a
+    // delta against their parent and every k-th one along a chain is full.
+    void set_storage(int k) {
+        kf_every = k > 1 ? k : 0;
+        files_map.iterate([this](const std::string&, fl*& f) { f->set_kf_every(kf_every); });
+        if (kf_every) console() << "Storage mode: DELTA (keyframe every " << kf_every << " versions)" << std::endl;
+        else console() << "Storage mode: FULL" << std::endl;
+    }
+
+    void show_stats() {
+        storage_stats st;
+        files_map.iterate([&st](const std::string&, fl*& f) { f->collect_stats(st); });
+        long long n = st.versions ? st.versions : 1;
+        if (kf_every) console() << "Storage mode     : DELTA (keyframe every " << kf_every << ")" << std::endl;
+        else console() << "Storage mode     : FULL" << std::endl;
+        console() << "Versions         : " << st.versions << std::endl;
+        console() << "Stored bytes     : " << st.stored_bytes << " (" << st.stored_bytes / n << " per version)" << std::endl;
+        console() << "Full-copy bytes  : " << st.full_bytes << " (" << st.full_bytes / n << " per version)" << std::endl;
+        console() << "Node pools       : " << st.pool_chunks << " chunks (" << st.pool_bytes << " bytes reserved)" << std::endl;
+        console() << "Avg reconstruct  : " << st.rebuild_ns / n / 1000.0 << " us" << std::endl;
+        console() << "Unique blobs     : " << blob_store::global().blob_cnt()
+                  << " (" << blob_store::global().unique_bytes() << " bytes)" << std::endl;
+        console() << "Dedup ratio      : " << dedup_ratio() << "x, " << dedup_saved() << " bytes saved" << std::endl;
+        long long postings = search_idx.posting_cnt();
+        console() << "Search index     : " << search_idx.trigram_cnt() << " trigrams, " << postings << " postings, "
+                  << search_idx.bytes() << " bytes (" << (postings ? (double)search_idx.bytes() / postings : 0)
+                  << " per posting)" << std::endl;
+    }
+
+    double dedup_ratio() const { return blob_store::global().dedup_ratio(); }
+    long long dedup_saved() const { return blob_store::global().bytes_saved(); }
+
+    void save_checkpoint(const std::string& path, long long jrn_records = 0, std::uint64_t jrn_sum = 0) {
+        auto start = std::chrono::steady_clock::now();
+        ckpt_writer w;
+        // Handle order, so a loaded checkpoint registers files in the order
+        // they were created rather than in the order of the name table.
+        for (fl* f : by_handle) f->save_to(w);
+        long long bytes = w.write(path, untitled_cnt, kf_every, jrn_records, jrn_sum);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (bytes < 0) {
+            console() << "Could not write checkpoint '" << path << "'." << std::endl;
+            return;
+        }
+        console() << "Checkpoint of " << w.file_cnt() << " files (" << w.node_cnt() << " versions, "
+                  << bytes << " bytes) written to '" << path << "' in " << ms << " ms." << std::endl;
+    }
+
+    long long ckpt_journal_records() const { return ckpt_jrn_records; }
+    std::uint64_t ckpt_journal_sum() const { return ckpt_jrn_sum; }
+
+    // Maps a checkpoint and registers its files; each version tree is only
+    // built when its file is first used. Names already present are kept.
+    void load_checkpoint(const std::string& path) {
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<ckpt_map> map = ckpt_map::open(path);
+        if (!map) {
+            console() << "Could not load checkpoint '" << path << "'." << std::endl;
+            return;
+        }
+        const ckpt_header& h = map->header();
+        size_t loaded = 0, skipped = 0;
+        for (size_t i = 0; i < h.file_cnt; ++i) {
+            const ckpt_file& cf = map->file_at(i);
+            std::string name = map->str(cf.name_off, cf.name_len);
+            fl* existing = nullptr;
+            if (files_map.find(name, existing)) {
+                ++skipped;
+                continue;
+            }
+            fl* f = new fl(name, map, i);
+            files_map.ins(name, f);
+            register_file(f);
+            ++loaded;
+        }
+        if (h.untitled_cnt > untitled_cnt) untitled_cnt = h.untitled_cnt;
+        kf_every = h.kf_every;
+        ckpt_jrn_records = h.jrn_records;
+        ckpt_jrn_sum = h.jrn_sum;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        console() << "Loaded " << loaded << " files (" << h.node_cnt << " versions) from '" << path
+                  << "' in " << ms << " ms." << std::endl;
+        if (skipped) console() << skipped << " files already existed and were kept." << std::endl;
+    }
+
+    void show_lca(std::string_view filename, int ver_a, int ver_b) {
+        fl* file = nullptr;
+        if (!files_map.find(filename, file)) {
+            console() << "File '" << filename << "' not found." << std::endl;
+            return;
+        }
+        tree_node* anc = file->lca(ver_a, ver_b);
+        if (!anc) {
+            console() << "Version " << ver_a << " or " << ver_b << " not found." << std::endl;
+            return;
+        }
+        console() << "Lowest common ancestor of V" << ver_a << " and V" << ver_b << ": V" << anc->version_id << std::endl;
+    }
+
+    void diff_versions(std::string_view filename, int ver_a, int ver_b) {
+        fl* file = nullptr;
+        if (!files_map.find(filename, file)) {
+            console() << "File '" << filename << "' not found." << std::endl;
+            return;
+        }
+        file->fault_in();
+        tree_node* a = nullptr;
+        tree_node* b = nullptr;
+        if (!file->version_map.find(ver_a, a) || !file->version_map.find(ver_b, b)) {
+            console() << "Version " << ver_a << " or " << ver_b << " not found." << std::endl;
+            return;
+        }
+        std::string text_a = a->get_content(), text_b = b->get_content();
+        auto start = std::chrono::steady_clock::now();
+        text_diff d(text_a, text_b);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        const char* unit = d.line_mode() ? " lines" : " words";
+        console() << "--- V" << ver_a << " (" << d.a_tokens() << unit << ")" << std::endl;
+        console() << "+++ V" << ver_b << " (" << d.b_tokens() << unit << ")" << std::endl;
+        if (d.hunks().empty()) {
+            console() << "No differences." << std::endl;
+        } else {
+            std::string out;
+            d.render(out);
+            console().write(out.data(), out.size());
+        }
+        console() << d.hunks().size() << " changes: " << d.deleted() << unit << " deleted, "
+                  << d.inserted() << unit << " inserted (" << ms << " ms)" << std::endl;
+    }
+
+    void merge_versions(std::string_view filename, int ours, int theirs) {
+        fl* file = nullptr;
+        if (!files_map.find(filename, file)) {
+            console() << "File '" << filename << "' not found." << std::endl;
+            return;
+        }
+        merge_report rep;
+        int before = file->total_versions;
+        auto start = std::chrono::steady_clock::now();
+        if (!file->merge(ours, theirs, rep)) return;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        index_change(file, before, "");
+        resized(file);
+        accessed_file(file);
+
+        console() << "Merged V" << theirs << " into V" << ours << " (base V" << rep.base->version_id << ") as V"
+                  << rep.result->version_id << ": " << rep.applied << " changes applied, "
+                  << rep.conflicts.size() << " conflicts (" << ms << " ms)" << std::endl;
+        for (size_t i = 0; i < rep.conflicts.size(); ++i) {
+            const text_merge::conflict& c = rep.conflicts[i];
+            console() << "Conflict " << i + 1 << " at base bytes " << c.base_off << "-" << c.base_off + c.base_len << std::endl;
+            console() << "  base : " << clip(c.base) << std::endl;
+            console() << "  V" << ours << " : " << clip(c.ours) << std::endl;
+            console() << "  V" << theirs << " : " << clip(c.theirs) << std::endl;
+        }
+        if (!rep.conflicts.empty()) console() << "Resolve the conflict markers with UPDATE, then SNAPSHOT." << std::endl;
+        remind_snapshot();
+    }
+
+    void prune_file(std::string_view filename) {
+        fl* file = nullptr;
+        if (!files_map.find(filename, file)) {
+            console() << "File '" << filename << "' not found." << std::endl;
+            return;
+        }
+        prune_stats st;
+        auto start = std::chrono::steady_clock::now();
+        file->prune(0, file->total_versions, std::chrono::steady_clock::time_point::max(), st);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        console() << "Pruned " << st.versions << " versions of '" << filename << "', reclaimed "
+                  << st.bytes << " bytes in " << fmt_ms(ms) << " ms." << std::endl;
+        remind_snapshot();
+    }
+
+    // Advances the GC sweep until the deadline passes or the cursor reaches
+    // until, and returns the cursor it stopped at. A finished sweep stops at
+    // {file count, 0} and starts over next time. Files still waiting in a
+    // checkpoint have not changed since it was written and are skipped rather
+    // than loaded.
+    gc_cursor gc_run(std::chrono::steady_clock::time_point deadline, gc_cursor until) {
+        if (gc_complete) {
+            gc_at = gc_cursor();
+            gc_sweep = prune_stats();
+            gc_complete = false;
+        }
+        while (gc_at.handle < (int)by_handle.size() && gc_at.handle <= until.handle) {
+            fl* f = by_handle[gc_at.handle];
+            int to = gc_at.handle == until.handle ? until.next_id : f->total_versions;
+            if (!f->ckpt) gc_at.next_id = f->prune(gc_at.next_id, to, deadline, gc_sweep);
+            else gc_at.next_id = to;
+            if (gc_at.next_id < f->total_versions) break;
+            gc_at.handle++;
+            gc_at.next_id = 0;
+        }
+        gc_complete = gc_at.handle >= (int)by_handle.size();
+        return gc_at;
+    }
+
+    // Dense handle of the named file, or -1 when there is no such file.
+    int handle_of(std::string_view filename) const {
+        fl* file = nullptr;
+        return files_map.find(filename, file) && file ? file->handle : -1;
+    }
+
+    bool gc_done() const { return gc_complete; }
+    const prune_stats& gc_stats() const { return gc_sweep; }
+    int file_cnt() const { return static_cast<int>(by_handle.size()); }
+
+    void set_gc_policy(int every, int budget_ms) {
+        gc_every = every > 0 ? every : 0;
+        gc_budget_ms = budget_ms > 0 ? budget_ms : 2;
+        gc_ops = 0;
+    }
+
+    // Counts a mutating command; true when the auto policy wants a slice.
+    bool gc_due() {
+        return gc_every > 0 && ++gc_ops % gc_every == 0;
+    }
+
+    int gc_budget() const { return gc_budget_ms; }
+
+    void read_at(std::string_view filename, time_t t) {
+        fl* file = nullptr;
+        if (!files_map.find(filename, file)) {
+            console() << "File '" << filename << "' not found." << std::endl;
+            return;
+        }
+        tree_node* node = file->ss_at(t);
+        if (!node) {
+            console() << "No snapshot of '" << filename << "' at or before " << fmt_ts(t) << "." << std::endl;
+            return;
+        }
+        console() << "'" << filename << "' @ V" << node->version_id << " (" << fmt_ts(node->ss_ts) << ") : "
+                  << node->get_content() << std::endl;
+        accessed_file(file);
+        remind_snapshot();
+    }
+
+    void switch_at(std::string_view filename, time_t t) {
+        fl* file = nullptr;
+        if (!files_map.find(filename, file)) {
+            console() << "File '" << filename << "' not found." << std::endl;
+            return;
+        }
+        tree_node* node = file->ss_at(t);
+        if (!node) {
+            console() << "No snapshot of '" << filename << "' at or before " << fmt_ts(t) << "." << std::endl;
+            return;
+        }
+        switch_version(filename, node->version_id);
+    }
+
+    // Writes every file as it stood at t (its latest snapshot by then) to
+    // path, or to the console when path is empty. Files without a snapshot by
+    // then are left out.
+    void export_at(time_t t, const std::string& path) {
+        auto start = std::chrono::steady_clock::now();
+        std::ofstream out_file;
+        if (!path.empty()) {
+            out_file.open(path, std::ios::binary | std::ios::trunc);
+            if (!out_file) {
+                console() << "Could not write '" << path << "'." << std::endl;
+                return;
+            }
+        }
+        std::ostream& os = path.empty() ? console() : out_file;
+        int exported = 0, absent = 0;
+        for (fl* f : by_handle) {
+            tree_node* node = f->ss_at(t);
+            if (!node) {
+                ++absent;
+                continue;
+            }
+            std::string text = node->get_content();
+            os << "=== " << f->get_name() << " @ V" << node->version_id << " (" << fmt_ts(node->ss_ts) << ")\n";
+            os.write(text.data(), text.size());
+            os << '\n';
+            ++exported;
+        }
+        os.flush();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        console() << "Exported " << exported << " files as of " << fmt_ts(t);
+        if (absent) console() << " (" << absent << " had no snapshot yet)";
+        if (!path.empty()) console() << " to '" << path << "'";
+        console() << " in " << ms << " ms." << std::endl;
+    }
+
+    // Lists the versions whose text contains pattern, in all files or in
+    // filename only. Index candidates are checked against the actual text,
+    // which also drops stale postings of edited or pruned versions; patterns
+    // under three bytes cannot use the index and check every version.
+    void search(const std::string& pattern, const std::string& filename) {
+        fl* only = nullptr;
+        if (!filename.empty() && !files_map.find(filename, only)) {
+            console() << "File '" << filename << "' not found." << std::endl;
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        int built = 0;
+        for (fl* f : by_handle) {
+            if (only && f != only) continue;
+            if (!indexed[f->handle]) ++built;
+            ensure_indexed(f);
+        }
+        std::vector<std::uint64_t> cand;
+        if (!search_idx.candidates(pattern, cand)) {
+            for (fl* f : by_handle) {
+                if (only && f != only) continue;
+                f->fault_in();
+                int h = f->handle;
+                f->version_map.iterate([&cand, h](const int& ver, tree_node*&) { cand.push_back(trigram_index::doc_id(h, ver)); });
+            }
+        }
+        std::sort(cand.begin(), cand.end());
+
+        std::vector<std::uint64_t> hits;
+        size_t checked = 0;
+        for (std::uint64_t id : cand) {
+            int h = trigram_index::doc_handle(id);
+            if (h >= (int)by_handle.size() || (only && h != only->handle)) continue;
+            tree_node* node = nullptr;
+            if (!by_handle[h]->version_map.find(trigram_index::doc_version(id), node)) continue;
+            ++checked;
+            std::string text = node->get_content();
+            if (std::string_view(text).find(pattern) != std::string_view::npos) hits.push_back(id);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::string out;
+        int files_hit = 0;
+        for (size_t i = 0; i < hits.size(); ++i) {
+            int h = trigram_index::doc_handle(hits[i]);
+            if (i == 0 || h != trigram_index::doc_handle(hits[i - 1])) {
+                if (i) out += '\n';
+                out += by_handle[h]->get_name() + " :";
+                ++files_hit;
+            }
+            out += " V" + std::to_string(trigram_index::doc_version(hits[i]));
+        }
+        if (!out.empty()) out += '\n';
+        console() << "'" << pattern << "' found in " << hits.size() << " versions of " << files_hit << " files ("
+                  << checked << " candidates checked";
+        if (built) console() << ", " << built << " files indexed first";
+        console() << ", " << ms << " ms)" << std::endl;
+        console().write(out.data(), out.size());
+    }
+
+    void show_active_version(std::string_view filename) {
         fl* file = nullptr;
         if (!files_map.find(filename, file)) {
-            std::cout << "File '" << filename << "' not found." << std::endl;
+            console() << "File '" << filename << "' not found." << std::endl;
             return;
         }
         file->print_active_version_info();
@@ -0,0 +1,103 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// 64-bit wyhash-style byte hash: a 128-bit multiply folds each 16-byte block,
+// which gives good avalanche on short keys and runs near memory speed on
+// long ones.
+
+std::uint64_t hash_mix(std::uint64_t a, std::uint64_t b) {
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<std::uint64_t>(r) ^ static_cast<std::uint64_t>(r >> 64);
+}
+
+std::uint64_t hash_r8(const char* p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+std::uint64_t hash_r4(const char* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+std::uint64_t hash_bytes(const char* p, size_t n, std::uint64_t seed = 0) {
+    const std::uint64_t s0 = 0xa0761d6478bd642full, s1 = 0xe7037ed1a0b428dbull;
+    const std::uint64_t s2 = 0x8ebc6af09c88c6e3ull, s3 = 0x589965cc75374cc3ull;
+    seed ^= hash_mix(seed ^ s0, s1);
+    std::uint64_t a = 0, b = 0;
+    if (n <= 16) {
+        if (n >= 4) {
+            size_t q = (n >> 3) << 2;
+            a = (hash_r4(p) << 32) | hash_r4(p + q);
+            b = (hash_r4(p + n - 4) << 32) | hash_r4(p + n - 4 - q);
+        } else if (n > 0) {
+            const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+            a = (std::uint64_t(u[0]) << 16) | (std::uint64_t(u[n >> 1]) << 8) | u[n - 1];
+        }
+    } else {
+        size_t i = n;
+        if (i > 48) {
+            std::uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = hash_mix(hash_r8(p) ^ s1, hash_r8(p + 8) ^ seed);
+                see1 = hash_mix(hash_r8(p + 16) ^ s2, hash_r8(p + 24) ^ see1);
+                see2 = hash_mix(hash_r8(p + 32) ^ s3, hash_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = hash_mix(hash_r8(p) ^ s1, hash_r8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = hash_r8(p + i - 16);
+        b = hash_r8(p + i - 8);
+    }
+    return hash_mix(s1 ^ n, hash_mix(a ^ s1, b ^ seed));
+}
+
+std::uint64_t hash_bytes(const std::string& s, std::uint64_t seed = 0) {
+    return hash_bytes(s.data(), s.size(), seed);
+}
+
+std::uint64_t hash_int(std::uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    return x ^ (x >> 33);
+}
+
+// Default hasher policy for hash_map. The string hasher takes string_view so
+// that lookups can be made without building a std::string; a custom hasher
+// for string keys must accept string_view as well.
+template <typename K>
+struct default_hash {
+    static_assert(sizeof(K) == 0, "Hash function not defined for this key type.");
+};
+
+template <>
+struct default_hash<std::string> {
+    size_t operator()(std::string_view key) const { return hash_bytes(key.data(), key.size()); }
+};
+
+template <>
+struct default_hash<int> {
+    size_t operator()(int key) const { return hash_int(static_cast<std::uint32_t>(key)); }
+};
+
+template <>
+struct default_hash<std::uint64_t> {
+    size_t operator()(std::uint64_t key) const { return hash_int(key); }
+};
+
+#endif // HASH_HPP
@@ -4,159 +4,197 @@
 #include <vector>
 #include <string>
 #include <iostream>
-#include "tree_node.hpp"
-
-template <typename K, typename V>
+#include <cstdint>
+#include <utility>
+#include <string_view>
+#include <type_traits>
+#include "hash.hpp"
+
+// Open-addressing table with Robin Hood probing. Entries live inline in one
+// flat array; a parallel byte array holds each slot's probe distance + 1
+// (0 = empty), so probes scan contiguous memory and a lookup can stop as soon
+// as it meets an entry closer to its home than the key would be. Capacity is
+// a power of two and doubles without limit.
+//
+// H is the hasher policy (see default_hash in hash.hpp). Maps keyed by
+// std::string also accept std::string_view in find and rm.
+template <typename K, typename V, typename H = default_hash<K>>
 class hash_map {
-    struct Node {
+    template <typename Q>
+    using if_view = std::enable_if_t<std::is_same<K, std::string>::value
+                                     && !std::is_same<std::decay_t<Q>, K>::value
+                                     && std::is_convertible<const Q&, std::string_view>::value>;
+
+    struct Slot {
         K key;
         V value;
-        Node* next;
-        Node(const K& k, const V& v) : key(k), value(v), next(nullptr) {}
+        size_t hash;
     };
 
-    std::vector<Node*> table;
+    std::vector<Slot> slots;
+    std::vector<std::uint8_t> dist;
     int size;
     int capacity;
-    const std::vector<int> capacities = {7, 17, 37, 79, 163, 331, 673, 1009};
-    int cap_in;
-    float max_load = 0.8f;
-
-    int hash_fn(const int& key) const { return key % capacity; }
-
-    int hash_fn(const std::string& key) const {
-        const int base = 131;
-        int hash = 0;
-        for (char c : key) {
-            hash = hash * base + static_cast<unsigned char>(c);
-        }
-        return hash % capacity;
-    }
+    size_t mask;
+    float max_load = 0.875f;
+    static const int max_dist = 255;
 
-    template<typename T>
-    int hash_fn(const T&) const {
-        static_assert(sizeof(T) == 0, "Hash function not defined for this key type.");
-        return 0;
-    }
+    H hasher;
 
     void clear();
+    void rehash(int new_capacity);
+    template <typename Q>
+    int find_slot(const Q& key) const;
+    bool rm_at(int idx);
+    void place(Slot cur);
+    bool find_at(int idx, V& value_out) const;
 
 public:
     hash_map();
     ~hash_map();
 
     void resize();
+    void compact();
     void ins(const K& key, const V& value);
-    bool find(const K& key, V& value_out) const;
-    bool rm(const K& key);
+    bool find(const K& key, V& value_out) const { return find_at(find_slot(key), value_out); }
+    bool rm(const K& key) { return rm_at(find_slot(key)); }
+
+    template <typename Q, typename = if_view<Q>>
+    bool find(const Q& key, V& value_out) const { return find_at(find_slot(std::string_view(key)), value_out); }
+    template <typename Q, typename = if_view<Q>>
+    bool rm(const Q& key) { return rm_at(find_slot(std::string_view(key))); }
+
+    int get_size() const { return size; }
     float get_load_factor() const { return static_cast<float>(size) / capacity; }
+    size_t bytes() const { return slots.capacity() * sizeof(Slot) + dist.capacity(); }
 
     template <typename Func>
     void iterate(Func func) {
         for (int i = 0; i < capacity; ++i) {
-            Node* curr = table[i];
-            while (curr) {
-                func(curr->key, curr->value);
-                curr = curr->next;
-            }
+            if (dist[i]) func(slots[i].key, slots[i].value);
         }
     }
 };
 
 // Implementation
-template <typename K, typename V>
-hash_map<K,V>::hash_map() : size(0), cap_in(0) {
-    capacity = capacities[cap_in];
-    table.resize(capacity, nullptr);
+template <typename K, typename V, typename H>
+hash_map<K,V,H>::hash_map() : size(0), capacity(8), mask(7) {
+    slots.resize(capacity);
+    dist.assign(capacity, 0);
 }
 
-template <typename K, typename V>
-hash_map<K,V>::~hash_map() {
+template <typename K, typename V, typename H>
+hash_map<K,V,H>::~hash_map() {
     clear();
 }
 
-template <typename K, typename V>
-void hash_map<K,V>::clear() {
-    for (auto& head : table) {
-        while (head) {
-            Node* temp = head;
-            head = head->next;
-            delete temp;
-        }
-    }
-    table.clear();
+template <typename K, typename V, typename H>
+void hash_map<K,V,H>::clear() {
+    slots.clear();
+    dist.clear();
     size = 0;
 }
 
-template <typename K, typename V>
-void hash_map<K,V>::resize() {
-    if (cap_in + 1 >= int(capacities.size())) return;
-    int new_capacity = capacities[++cap_in];
-    std::vector<Node*> new_table(new_capacity, nullptr);
-
-    for (int i = 0; i < capacity; ++i) {
-        Node* curr = table[i];
-        while (curr) {
-            Node* next_node = curr->next;
-            int new_index = hash_fn(curr->key); // Use hash_fn for proper type
-            curr->next = new_table[new_index];
-            new_table[new_index] = curr;
-            curr = next_node;
-        }
-    }
-    table = std::move(new_table);
+template <typename K, typename V, typename H>
+void hash_map<K,V,H>::resize() {
+    rehash(capacity * 2);
+}
+
+// Shrinks to the smallest power of two that keeps the load under max_load,
+// e.g. after many removals.
+template <typename K, typename V, typename H>
+void hash_map<K,V,H>::compact() {
+    int cap = 8;
+    while (size > cap * max_load) cap *= 2;
+    if (cap < capacity) rehash(cap);
+}
+
+template <typename K, typename V, typename H>
+void hash_map<K,V,H>::rehash(int new_capacity) {
+    std::vector<Slot> old_slots = std::move(slots);
+    std::vector<std::uint8_t> old_dist = std::move(dist);
+    int old_capacity = capacity;
+
     capacity = new_capacity;
+    mask = static_cast<size_t>(capacity) - 1;
+    slots = std::vector<Slot>(capacity);
+    dist.assign(capacity, 0);
+    for (int i = 0; i < old_capacity; ++i) {
+        if (old_dist[i]) place(std::move(old_slots[i]));
+    }
+}
+
+template <typename K, typename V, typename H>
+template <typename Q>
+int hash_map<K,V,H>::find_slot(const Q& key) const {
+    size_t h = hasher(key);
+    size_t i = h & mask;
+    for (int d = 1; dist[i] >= d; ++d) {
+        if (slots[i].hash == h && slots[i].key == key) return static_cast<int>(i);
+        i = (i + 1) & mask;
+    }
+    return -1;
 }
 
-template <typename K, typename V>
-void hash_map<K,V>::ins(const K& key, const V& value) {
-    int index = hash_fn(key);
-    Node* curr = table[index];
-    while (curr) {
-        if (curr->key == key) {
-            curr->value = value;
+// Inserts an entry known to be absent, displacing richer entries on the way.
+template <typename K, typename V, typename H>
+void hash_map<K,V,H>::place(Slot cur) {
+    size_t i = cur.hash & mask;
+    int d = 1;
+    while (dist[i]) {
+        if (dist[i] < d) {
+            std::swap(cur, slots[i]);
+            int held = dist[i];
+            dist[i] = static_cast<std::uint8_t>(d);
+            d = held;
+        }
+        i = (i + 1) & mask;
+        if (++d > max_dist) {
+            resize();
+            place(std::move(cur));
             return;
         }
-        curr = curr->next;
     }
-    Node* new_node = new Node(key, value);
-    new_node->next = table[index];
-    table[index] = new_node;
-    ++size;
-    if (get_load_factor() > max_load) resize();
+    slots[i] = std::move(cur);
+    dist[i] = static_cast<std::uint8_t>(d);
 }
 
-template <typename K, typename V>
-bool hash_map<K,V>::find(const K& key, V& value_out) const {
-    int index = hash_fn(key);
-    Node* curr = table[index];
-    while (curr) {
-        if (curr->key == key) {
-            value_out = curr->value;
-            return true;
-        }
-        curr = curr->next;
+template <typename K, typename V, typename H>
+void hash_map<K,V,H>::ins(const K& key, const V& value) {
+    int idx = find_slot(key);
+    if (idx >= 0) {
+        slots[idx].value = value;
+        return;
     }
-    return false;
+    if (size + 1 > capacity * max_load) resize();
+    place(Slot{key, value, hasher(key)});
+    ++size;
 }
 
-template <typename K, typename V>
-bool hash_map<K,V>::rm(const K& key) {
-    int index = hash_fn(key);
-    Node* curr = table[index];
-    Node* prev = nullptr;
-    while (curr) {
-        if (curr->key == key) {
-            if (prev) prev->next = curr->next;
-            else table[index] = curr->next;
-            delete curr;
-            --size;
-            return true;
-        }
-        prev = curr;
-        curr = curr->next;
+template <typename K, typename V, typename H>
+bool hash_map<K,V,H>::find_at(int idx, V& value_out) const {
+    if (idx < 0) return false;
+    value_out = slots[idx].value;
+    return true;
+}
+
+// Backward-shift deletion: pull the following cluster one slot closer to
+// home instead of leaving a tombstone.
+template <typename K, typename V, typename H>
+bool hash_map<K,V,H>::rm_at(int idx) {
+    if (idx < 0) return false;
+    size_t i = static_cast<size_t>(idx);
+    size_t j = (i + 1) & mask;
+    while (dist[j] > 1) {
+        slots[i] = std::move(slots[j]);
+        dist[i] = static_cast<std::uint8_t>(dist[j] - 1);
+        i = j;
+        j = (j + 1) & mask;
     }
-    return false;
+    slots[i] = Slot{};
+    dist[i] = 0;
+    --size;
+    return true;
 }
 
 #endif // HASH_MAP_HPP
@@ -4,21 +4,30 @@
 #include <vector>
 #include <iostream>
 #include <string>
-#include "hash_map.hpp"
+#include <algorithm>
 
+// Indexed max-heap keyed by small integer handles. pos[handle] tracks where
+// each handle sits in elements, so a swap is two slot writes and the sift
+// loops never hash or allocate.
 class heap {
 public:
     heap() {}
     ~heap() {}
 
-    void ins(const std::string& key, int value);
-    void rm(const std::string& key);
-    void upd(const std::string& key, int new_val);
-    void print_top(int num) const;
+    void ins(int key, int value);
+    void rm(int key);
+    void upd(int key, int new_val);
+    bool contains(int key) const { return key >= 0 && key < (int)pos.size() && pos[key] >= 0; }
+    int get_size() const { return static_cast<int>(elements.size()); }
+
+    std::vector<std::pair<int, int>> top(int num) const;
+
+    template <typename NameFn>
+    void print_top(std::ostream& os, int num, NameFn name_of) const;
 
 private:
-    std::vector<std::pair<std::string, int>> elements;
-    hash_map<std::string, int> key_to_idx;
+    std::vector<std::pair<int, int>> elements;
+    std::vector<int> pos;
 
     int parent(int i) const { return (i - 1) / 2; }
     int left_child(int i) const { return 2 * i + 1; }
@@ -32,13 +41,9 @@ private:
 using hp = heap;
 
 void heap::swap_els(int i, int j) {
-    key_to_idx.rm(elements[i].first);
-    key_to_idx.rm(elements[j].first);
-
     std::swap(elements[i], elements[j]);
-
-    key_to_idx.ins(elements[i].first, i);
-    key_to_idx.ins(elements[j].first, j);
+    pos[elements[i].first] = i;
+    pos[elements[j].first] = j;
 }
 
 void heap::heapify_up(int idx) {
@@ -63,59 +68,68 @@ void heap::heapify_down(int idx) {
     }
 }
 
-void heap::ins(const std::string& key, int value) {
-    int idx;
-    if (key_to_idx.find(key, idx)) { upd(key, value); return; }
+void heap::ins(int key, int value) {
+    if (key < 0) return;
+    if (contains(key)) { upd(key, value); return; }
+    if (key >= (int)pos.size()) pos.resize(key + 1, -1);
     elements.push_back({key, value});
     int new_idx = elements.size() - 1;
-    key_to_idx.ins(key, new_idx);
+    pos[key] = new_idx;
     heapify_up(new_idx);
 }
 
-void heap::rm(const std::string& key) {
-    int idx;
-    if (!key_to_idx.find(key, idx)) return;
+void heap::rm(int key) {
+    if (!contains(key)) return;
+    int idx = pos[key];
     int last = elements.size() - 1;
     if (idx != last) swap_els(idx, last);
-    key_to_idx.rm(elements.back().first);
+    pos[key] = -1;
     elements.pop_back();
     if (idx < (int)elements.size()) { heapify_up(idx); heapify_down(idx); }
 }
 
-void heap::upd(const std::string& key, int new_val) {
-    int idx;
-    if (!key_to_idx.find(key, idx)) return;
+void heap::upd(int key, int new_val) {
+    if (!contains(key)) return;
+    int idx = pos[key];
     int old_val = elements[idx].second;
     elements[idx].second = new_val;
     if (new_val > old_val) heapify_up(idx);
     else if (new_val < old_val) heapify_down(idx);
 }
 
-void heap::print_top(int num) const {
-    if (num <= 0 || elements.empty()) { std::cout << "Heap is empty.\n"; return; }
-
-    // Use a temporary min-heap index list (no full copy)
-    std::vector<std::pair<std::string,int>> temp = elements;
-    auto temp_swap = [](std::vector<std::pair<std::string,int>>& arr, int i, int j){
-        std::swap(arr[i], arr[j]);
+// The k largest entries, best first, in O(k log k): the next largest is always
+// a child of an entry already taken, so only the frontier of the implicit
+// tree is kept in a small auxiliary heap of positions.
+std::vector<std::pair<int, int>> heap::top(int num) const {
+    std::vector<std::pair<int, int>> out;
+    if (num <= 0 || elements.empty()) return out;
+    int n = std::min(num, (int)elements.size());
+    out.reserve(n);
+
+    auto less = [this](int a, int b) {
+        if (elements[a].second != elements[b].second) return elements[a].second < elements[b].second;
+        return a > b;
     };
+    std::vector<int> frontier;
+    frontier.reserve(n + 1);
+    frontier.push_back(0);
+    while ((int)out.size() < n) {
+        std::pop_heap(frontier.begin(), frontier.end(), less);
+        int idx = frontier.back();
+        frontier.pop_back();
+        out.push_back(elements[idx]);
+        int l = left_child(idx), r = right_child(idx);
+        if (l < (int)elements.size()) { frontier.push_back(l); std::push_heap(frontier.begin(), frontier.end(), less); }
+        if (r < (int)elements.size()) { frontier.push_back(r); std::push_heap(frontier.begin(), frontier.end(), less); }
+    }
+    return out;
+}
 
-    int n = std::min(num, (int)temp.size());
-    for (int i = 0; i < n; ++i) {
-        std::cout << temp[0].first << " : " << temp[0].second << "\n";
-        int last = temp.size() - 1;
-        temp_swap(temp, 0, last);
-        temp.pop_back();
-
-        int idx = 0;
-        while (true) {
-            int largest = idx;
-            int l = 2*idx + 1, r = 2*idx + 2;
-            if (l < (int)temp.size() && temp[l].second > temp[largest].second) largest = l;
-            if (r < (int)temp.size() && temp[r].second > temp[largest].second) largest = r;
-            if (largest != idx) { temp_swap(temp, idx, largest); idx = largest; }
-            else break;
-        }
+template <typename NameFn>
+void heap::print_top(std::ostream& os, int num, NameFn name_of) const {
+    if (num <= 0 || elements.empty()) { os << "Heap is empty.\n"; return; }
+    for (const auto& e : top(num)) {
+        os << name_of(e.first) << " : " << e.second << "\n";
     }
 }
 
@@ -0,0 +1,182 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hash.hpp"
+
+// Append-only write-ahead log of mutating commands. Each record is
+//   u32 length | i64 timestamp | u64 checksum | payload
+// Records are gathered into groups and written with a single write(); an
+// fsync is issued every sync_every records. On replay, the first record that
+// is short or fails its checksum marks a torn tail and is truncated away.
+//
+// A checkpoint taken while journaling records how many records it already
+// covers and the checksum of the last one; replaying on top of it skips
+// those, provided the journal still has that record at that position.
+class journal {
+public:
+    journal();
+    ~journal();
+
+    bool open(const std::string& path, int group = 1, int sync_every = 32);
+    void append(time_t ts, std::string_view cmd);
+    void flush();
+    void sync();
+    bool is_open() const { return fd >= 0; }
+    long long torn_offset() const { return torn_at; }
+    // Records in the log so far (replayed and appended) and the checksum of
+    // the last one, which together mark a position for a checkpoint.
+    long long record_cnt() const { return records; }
+    std::uint64_t last_checksum() const { return last_sum; }
+    // Records passed over by the last replay because a checkpoint had them;
+    // -1 when the log did not continue that checkpoint and was replayed whole.
+    long long skipped_cnt() const { return skipped; }
+
+    template <typename Func>
+    long long replay(const std::string& path, Func apply, long long covered = 0, std::uint64_t covered_sum = 0);
+
+private:
+    static const size_t header_len = 4 + 8 + 8;
+
+    int fd;
+    std::string pending;
+    int pending_cnt;
+    int group_size;
+    int sync_every;
+    int unsynced;
+    long long torn_at;
+    long long records;
+    std::uint64_t last_sum;
+    long long skipped;
+
+    static std::uint64_t checksum(time_t ts, const char* data, size_t len);
+};
+
+// Implementation
+journal::journal()
+    : fd(-1), pending_cnt(0), group_size(1), sync_every(32), unsynced(0), torn_at(-1),
+      records(0), last_sum(0), skipped(0) {}
+
+journal::~journal() {
+    if (fd < 0) return;
+    sync();
+    ::close(fd);
+}
+
+std::uint64_t journal::checksum(time_t ts, const char* data, size_t len) {
+    return hash_bytes(data, len, static_cast<std::uint64_t>(ts) ^ (std::uint64_t(len) << 32));
+}
+
+bool journal::open(const std::string& path, int group, int sync_n) {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    group_size = group > 0 ? group : 1;
+    sync_every = sync_n > 0 ? sync_n : 0;
+    return fd >= 0;
+}
+
+void journal::append(time_t ts, std::string_view cmd) {
+    if (fd < 0) return;
+    char head[header_len];
+    std::uint32_t len = static_cast<std::uint32_t>(cmd.size());
+    std::int64_t t = ts;
+    std::uint64_t sum = checksum(ts, cmd.data(), cmd.size());
+    std::memcpy(head, &len, 4);
+    std::memcpy(head + 4, &t, 8);
+    std::memcpy(head + 12, &sum, 8);
+    pending.append(head, header_len);
+    pending.append(cmd);
+    ++records;
+    last_sum = sum;
+    if (++pending_cnt >= group_size) flush();
+}
+
+void journal::flush() {
+    if (fd < 0 || pending.empty()) return;
+    const char* p = pending.data();
+    size_t left = pending.size();
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n <= 0) break;
+        p += n;
+        left -= n;
+    }
+    unsynced += pending_cnt;
+    pending.clear();
+    pending_cnt = 0;
+    if (sync_every && unsynced >= sync_every) {
+        ::fsync(fd);
+        unsynced = 0;
+    }
+}
+
+void journal::sync() {
+    flush();
+    if (fd >= 0 && unsynced) {
+        ::fsync(fd);
+        unsynced = 0;
+    }
+}
+
+// Feeds every intact record after the first covered ones to apply(ts, cmd)
+// and returns how many were applied. A missing journal is an empty one.
+template <typename Func>
+long long journal::replay(const std::string& path, Func apply, long long covered, std::uint64_t covered_sum) {
+    int in = ::open(path.c_str(), O_RDWR);
+    if (in < 0) return 0;
+    std::string data;
+    char buf[1 << 16];
+    ssize_t n;
+    while ((n = ::read(in, buf, sizeof(buf))) > 0) data.append(buf, n);
+
+    // Intact records are located first, so that whether the checkpoint's
+    // records are really at the front is known before any is applied.
+    std::vector<size_t> starts;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        if (data.size() - pos < header_len) break;
+        std::uint32_t len;
+        std::int64_t t;
+        std::uint64_t sum;
+        std::memcpy(&len, data.data() + pos, 4);
+        std::memcpy(&t, data.data() + pos + 4, 8);
+        std::memcpy(&sum, data.data() + pos + 12, 8);
+        if (data.size() - pos - header_len < len) break;
+        if (checksum(t, data.data() + pos + header_len, len) != sum) break;
+        starts.push_back(pos);
+        last_sum = sum;
+        pos += header_len + len;
+    }
+    records = static_cast<long long>(starts.size());
+
+    skipped = 0;
+    if (covered > 0 && records > 0) {
+        std::uint64_t sum = 0;
+        if (covered <= records) std::memcpy(&sum, data.data() + starts[covered - 1] + 12, 8);
+        skipped = covered <= records && sum == covered_sum ? covered : -1;
+    }
+    long long applied = 0;
+    for (size_t i = skipped > 0 ? static_cast<size_t>(skipped) : 0; i < starts.size(); ++i) {
+        std::uint32_t len;
+        std::int64_t t;
+        std::memcpy(&len, data.data() + starts[i], 4);
+        std::memcpy(&t, data.data() + starts[i] + 4, 8);
+        apply(static_cast<time_t>(t), std::string(data.data() + starts[i] + header_len, len));
+        ++applied;
+    }
+    if (pos < data.size()) {
+        torn_at = static_cast<long long>(pos);
+        if (::ftruncate(in, static_cast<off_t>(pos)) == 0) ::fsync(in);
+    }
+    ::close(in);
+    return applied;
+}
+
+#endif // JOURNAL_HPP
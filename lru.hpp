@@ -0,0 +1,90 @@
+#ifndef LRU_HPP
+#define LRU_HPP
+
+#include <vector>
+#include "hash_map.hpp"
+
+// Bounded recency list. Entries live in a fixed pool of slots linked into a
+// doubly linked list (most recent at head) by index, with a hash index from
+// key to slot, so touch is O(1), repeated touches of one key keep a single
+// entry, and once full the least recent key is evicted and its slot reused.
+class lru_list {
+    struct Slot {
+        int key;
+        int prev;
+        int next;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<int> free_slots;
+    hash_map<int, int> index;
+    int head;
+    int tail;
+    int cap;
+
+    void unlink(int s);
+    void push_front(int s);
+
+public:
+    explicit lru_list(int capacity = 1024);
+
+    void touch(int key);
+    void rm(int key);
+    int get_size() const { return index.get_size(); }
+
+    // Visits up to num keys, most recent first.
+    template <typename Func>
+    void recent(int num, Func func) const {
+        for (int s = head; s >= 0 && num > 0; s = slots[s].next, --num) func(slots[s].key);
+    }
+};
+
+// Implementation
+lru_list::lru_list(int capacity) : head(-1), tail(-1), cap(capacity > 0 ? capacity : 1) {}
+
+void lru_list::unlink(int s) {
+    Slot& e = slots[s];
+    if (e.prev >= 0) slots[e.prev].next = e.next; else head = e.next;
+    if (e.next >= 0) slots[e.next].prev = e.prev; else tail = e.prev;
+    e.prev = e.next = -1;
+}
+
+void lru_list::push_front(int s) {
+    slots[s].prev = -1;
+    slots[s].next = head;
+    if (head >= 0) slots[head].prev = s;
+    head = s;
+    if (tail < 0) tail = s;
+}
+
+void lru_list::touch(int key) {
+    int s;
+    if (index.find(key, s)) {
+        if (s != head) { unlink(s); push_front(s); }
+        return;
+    }
+    if (!free_slots.empty()) {
+        s = free_slots.back();
+        free_slots.pop_back();
+    } else if ((int)slots.size() < cap) {
+        s = static_cast<int>(slots.size());
+        slots.push_back({key, -1, -1});
+    } else {
+        s = tail;
+        unlink(s);
+        index.rm(slots[s].key);
+    }
+    slots[s].key = key;
+    index.ins(key, s);
+    push_front(s);
+}
+
+void lru_list::rm(int key) {
+    int s;
+    if (!index.find(key, s)) return;
+    unlink(s);
+    index.rm(key);
+    free_slots.push_back(s);
+}
+
+#endif // LRU_HPP
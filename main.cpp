@@ -1,12 +1,159 @@
 #include <iostream>
 #include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <string_view>
+#include <memory>
 #include "file_system.hpp"
 #include "commands.hpp"
 #include "art.hpp"
+#include "journal.hpp"
+#include "batch_io.hpp"
+#include "parallel_exec.hpp"
+#include "bench.hpp"
 
-int main() {
+// Re-executes a journal with output muted and reports replay throughput.
+// The first covered records are already in the startup checkpoint and are
+// skipped (see journal::replay).
+void replay_journal(journal& jrn, const std::string& path, CommandHandler& handler,
+                    long long covered, std::uint64_t covered_sum) {
+    std::streambuf* out = std::cout.rdbuf(nullptr);
+    handler.set_replaying(true);
+    auto start = std::chrono::steady_clock::now();
+    long long n = jrn.replay(path, [&handler](time_t ts, const std::string& cmd) {
+        pinned_ts() = ts;
+        handler.execute(cmd);
+        pinned_ts() = 0;
+    }, covered, covered_sum);
+    auto stop = std::chrono::steady_clock::now();
+    handler.set_replaying(false);
+    std::cout.rdbuf(out);
+
+    double secs = std::chrono::duration<double>(stop - start).count();
+    std::cout << "[*]Replayed " << n << " commands from '" << path << "' in "
+              << secs * 1000.0 << " ms (" << (secs > 0 ? n / secs : 0) << " cmds/s)" << std::endl;
+    if (jrn.skipped_cnt() > 0)
+        std::cout << "[*]Skipped " << jrn.skipped_cnt() << " commands already in the checkpoint." << std::endl;
+    else if (jrn.skipped_cnt() < 0)
+        std::cout << "[*]Journal does not continue the checkpoint; it was replayed whole." << std::endl;
+    if (jrn.torn_offset() >= 0)
+        std::cout << "[*]Journal had a torn tail; truncated at byte " << jrn.torn_offset() << "." << std::endl;
+}
+
+// Maps the startup checkpoint, then replays the journal and keeps it open.
+void open_state(file_system& fs, journal& jrn, CommandHandler& handler, const std::string& load_path,
+                const std::string& journal_path, int group, int sync_every) {
+    if (!load_path.empty()) fs.load_checkpoint(load_path);
+    if (!journal_path.empty()) {
+        replay_journal(jrn, journal_path, handler, fs.ckpt_journal_records(), fs.ckpt_journal_sum());
+        if (jrn.open(journal_path, group, sync_every)) handler.attach_journal(&jrn);
+        else std::cout << "[*]Could not open journal '" << journal_path << "'." << std::endl;
+    }
+}
+
+struct batch_opts {
+    std::string path;
+    bool parse_only = false;
+    int threads = 0;
+};
+
+// Runs the commands of opt.path ("-" for stdin) until EXIT or the end of
+// input. There is no prompt: a leading ON/OFF line, as in the interactive
+// transcript, sets Art Mode. All output goes through one large buffer, and
+// the throughput is reported on stderr once it has been written out. With
+// parse_only the lines are only tokenized and their verbs looked up, which
+// times the parser on its own; with threads > 0 commands on different files
+// run in parallel (see parallel_exec.hpp).
+int run_batch(const batch_opts& opt, file_system& fs, ArtMode& art, journal& jrn,
+              const std::string& load_path, const std::string& journal_path, int group, int sync_every) {
+    std::FILE* src = opt.path == "-" ? stdin : std::fopen(opt.path.c_str(), "rb");
+    if (!src) {
+        std::cerr << "[*]Could not open batch input '" << opt.path << "'." << std::endl;
+        return 1;
+    }
+    batch_in in(src);
+    batch_out out(stdout);
+    std::streambuf* prev = std::cout.rdbuf(&out);
+
+    std::string_view line;
+    bool pending = in.next(line);
+    while (pending && line.empty()) pending = in.next(line);
+    if (pending && (line == "ON" || line == "on" || line == "OFF" || line == "off")) {
+        art.set_enabled(line == "ON" || line == "on");
+        pending = in.next(line);
+    }
+
+    CommandHandler handler(fs, art);
+    open_state(fs, jrn, handler, load_path, journal_path, group, sync_every);
+    std::unique_ptr<parallel_exec> par;
+    if (opt.threads > 0 && !opt.parse_only) par.reset(new parallel_exec(handler, fs, opt.threads));
+
+    auto start = std::chrono::steady_clock::now();
+    long long n = 0, words = 0, unknown = 0;
+    for (; pending; pending = in.next(line)) {
+        if (line.empty()) continue;
+        ++n;
+        if (opt.parse_only) {
+            int verb;
+            words += CommandHandler::parse_only(line, verb);
+            unknown += verb < 0;
+        }
+        else if (par ? !par->submit(line) : !handler.execute(line)) break;
+    }
+    if (par) par->flush();
+    auto stop = std::chrono::steady_clock::now();
+
+    if (par) {
+        std::cerr << "[*]Parallel: " << par->threads() << " threads, " << par->segment_cnt() << " segments, "
+                  << par->task_cnt() << " file tasks, " << par->steal_cnt() << " steals." << std::endl;
+        par.reset();
+    }
+    out.drain();
+    std::cout.rdbuf(prev);
+    if (src != stdin) std::fclose(src);
+
+    double secs = std::chrono::duration<double>(stop - start).count();
+    if (opt.parse_only) {
+        std::cerr << "[*]Parsed " << n << " commands (" << words << " words, " << unknown << " unknown verbs) in "
+                  << secs * 1000.0 << " ms: " << (n > 0 ? secs * 1e9 / n : 0) << " ns/command." << std::endl;
+        return 0;
+    }
+    std::cerr << "[*]Batch: " << n << " commands in " << secs * 1000.0 << " ms ("
+              << static_cast<long long>(secs > 0 ? n / secs : 0) << " cmds/s), " << out.bytes_written() << " bytes of output." << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
     file_system fs;
     ArtMode art;
+    journal jrn;
+
+    std::string journal_path, load_path;
+    batch_opts batch;
+    int group = 1, sync_every = 32;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--journal" && i + 1 < argc) journal_path = argv[++i];
+        else if (arg == "--load" && i + 1 < argc) load_path = argv[++i];
+        else if (arg == "--group" && i + 1 < argc) group = std::atoi(argv[++i]);
+        else if (arg == "--fsync-every" && i + 1 < argc) sync_every = std::atoi(argv[++i]);
+        else if (arg == "--batch" && i + 1 < argc) batch.path = argv[++i];
+        else if (arg == "--parse-only") batch.parse_only = true;
+        else if (arg == "--threads" && i + 1 < argc) batch.threads = std::atoi(argv[++i]);
+        else if (arg == "--hash-bench" && i + 1 < argc) return run_hash_bench(std::atoi(argv[++i]));
+        else if (arg == "--heap-bench" && i + 1 < argc) return run_heap_bench(std::atoi(argv[++i]));
+        else if (arg == "--rollback-bench" && i + 1 < argc) return run_rollback_bench(std::atoi(argv[++i]));
+        else if (arg == "--pool-bench" && i + 1 < argc) return run_pool_bench(std::atoi(argv[++i]));
+        else if (arg == "--diff-bench" && i + 1 < argc) return run_diff_bench(std::atoi(argv[++i]));
+        else if (arg == "--merge-bench" && i + 1 < argc) return run_merge_bench(std::atoi(argv[++i]));
+        else if (arg == "--search-bench" && i + 1 < argc) return run_search_bench(std::atoi(argv[++i]));
+        else if (arg == "--ckpt-bench" && i + 1 < argc) return run_ckpt_bench(std::atoi(argv[++i]));
+        else if (arg == "--map-bench" && i + 1 < argc) return run_map_bench(std::atoi(argv[++i]));
+        else if (arg == "--read-bench" && i + 1 < argc) return run_read_bench(std::atoi(argv[++i]));
+    }
+    if (!batch.path.empty())
+        return run_batch(batch, fs, art, jrn, load_path, journal_path, group, sync_every);
 
     std::string art_input;
     std::cout<<"-----------------------------------------"<<std::endl;
@@ -17,18 +164,17 @@ int main() {
     std::cout<<"-----------------------------------------"<<std::endl;
 
     CommandHandler handler(fs, art);
-    
+
+    open_state(fs, jrn, handler, load_path, journal_path, group, sync_every);
 
     std::cout << "[*]File System Ready."<<"\n"<< "[*]Note: all programs must end with 'EXIT'." << std::endl;
     std::cout<<"-----------------------------------------"<<std::endl;
 
     std::string command;
-    while (true) {
-        std::getline(std::cin, command);
-
+    while (std::getline(std::cin, command)) {
         if (command.empty()) continue; 
 
-        handler.execute(command);
+        if (!handler.execute(command)) break;
     }
 
     return 0;
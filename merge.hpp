@@ -0,0 +1,130 @@
+#ifndef MERGE_HPP
+#define MERGE_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "diff.hpp"
+
+// Three-way merge of two texts that both descend from base. Each side is
+// diffed against base; the hunks of both sides are then swept together in
+// base order. Hunks that overlap or touch form one region: if only one side
+// changed it, or both made the same change, the change is taken; otherwise
+// the region is a conflict and both versions are kept between markers. The
+// sweep is linear in the number of hunks, and everything between regions is
+// copied from base.
+class text_merge {
+public:
+    struct conflict {
+        size_t base_off;
+        size_t base_len;
+        std::string base, ours, theirs;
+    };
+
+    text_merge(const std::string& base, const std::string& ours, const std::string& theirs,
+               const std::string& ours_tag = "ours", const std::string& theirs_tag = "theirs");
+
+    const std::string& text() const { return merged; }
+    const std::vector<conflict>& conflicts() const { return clashes; }
+    int applied() const { return taken; }
+    bool line_mode() const { return by_line; }
+
+private:
+    struct edit {
+        size_t lo, hi;
+        int side;
+        const text_diff::hunk* h;
+    };
+
+    const std::string& base;
+    const std::string& ours;
+    const std::string& theirs;
+    bool by_line;
+    std::string merged;
+    std::vector<conflict> clashes;
+    int taken;
+
+    std::string side_text(const std::string& side, const std::vector<edit>& group, int which, size_t lo, size_t hi) const;
+    void mark(std::string& out, const std::string& tag, const char* marker) const;
+};
+
+// Implementation
+text_merge::text_merge(const std::string& b, const std::string& o, const std::string& t,
+                       const std::string& ours_tag, const std::string& theirs_tag)
+    : base(b), ours(o), theirs(t), taken(0) {
+    by_line = base.find('\n') != std::string::npos || ours.find('\n') != std::string::npos
+           || theirs.find('\n') != std::string::npos;
+    text_diff d_ours(base, ours, 1 << 14, by_line);
+    text_diff d_theirs(base, theirs, 1 << 14, by_line);
+
+    std::vector<edit> edits;
+    edits.reserve(d_ours.hunks().size() + d_theirs.hunks().size());
+    for (const auto& h : d_ours.hunks()) edits.push_back({h.a_off, h.a_off + h.a_len, 0, &h});
+    for (const auto& h : d_theirs.hunks()) edits.push_back({h.a_off, h.a_off + h.a_len, 1, &h});
+    // Both lists are already in base order, so a merge beats a full sort.
+    std::inplace_merge(edits.begin(), edits.begin() + d_ours.hunks().size(), edits.end(),
+                       [](const edit& x, const edit& y) { return x.lo < y.lo; });
+
+    merged.reserve(std::max(ours.size(), theirs.size()));
+    size_t pos = 0;
+    std::vector<edit> group;
+    for (size_t i = 0; i < edits.size();) {
+        group.assign(1, edits[i]);
+        size_t lo = edits[i].lo, hi = edits[i].hi;
+        bool both = false;
+        for (++i; i < edits.size() && edits[i].lo <= hi; ++i) {
+            both = both || edits[i].side != group[0].side;
+            hi = std::max(hi, edits[i].hi);
+            group.push_back(edits[i]);
+        }
+        merged.append(base, pos, lo - pos);
+        pos = hi;
+        std::string mine = side_text(ours, group, 0, lo, hi);
+        if (!both) {
+            merged += group[0].side == 0 ? mine : side_text(theirs, group, 1, lo, hi);
+            ++taken;
+            continue;
+        }
+        std::string other = side_text(theirs, group, 1, lo, hi);
+        if (mine == other) {
+            merged += mine;
+            ++taken;
+            continue;
+        }
+        clashes.push_back({lo, hi - lo, base.substr(lo, hi - lo), mine, other});
+        mark(merged, ours_tag, "<<<<<<< ");
+        merged += mine;
+        mark(merged, "", "=======");
+        merged += other;
+        mark(merged, theirs_tag, ">>>>>>> ");
+    }
+    merged.append(base, pos, std::string::npos);
+}
+
+// What one side turned base[lo, hi) into: its own hunks inside the region,
+// with the untouched stretches between them copied from base.
+std::string text_merge::side_text(const std::string& side, const std::vector<edit>& group, int which, size_t lo, size_t hi) const {
+    std::string out;
+    size_t pos = lo;
+    for (const edit& e : group) {
+        if (e.side != which) continue;
+        out.append(base, pos, e.lo - pos);
+        out.append(side, e.h->b_off, e.h->b_len);
+        pos = e.hi;
+    }
+    out.append(base, pos, hi - pos);
+    return out;
+}
+
+// Markers sit on lines of their own in line mode and are space separated in
+// word mode.
+void text_merge::mark(std::string& out, const std::string& tag, const char* marker) const {
+    char sep = by_line ? '\n' : ' ';
+    if (!out.empty() && out.back() != sep && out.back() != '\n') out += sep;
+    out += marker;
+    out += tag;
+    if (!out.empty() && out.back() == ' ') out.pop_back();
+    out += sep;
+}
+
+#endif // MERGE_HPP
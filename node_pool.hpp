@@ -0,0 +1,108 @@
+#ifndef NODE_POOL_HPP
+#define NODE_POOL_HPP
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
+#include <cstddef>
+
+// Slab allocator for objects of one type. Storage comes in chunks that double
+// in size up to a cap, objects are carved out with a bump pointer, and freed
+// slots go onto an intrusive free list for reuse. The pool never runs
+// destructors on its own: the owner destroys live objects, then dropping the
+// pool returns whole chunks at once.
+template <typename T>
+class node_pool {
+    union Cell {
+        Cell* next;
+        alignas(T) unsigned char raw[sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Cell[]>> chunks;
+    Cell* bump;
+    Cell* bump_end;
+    Cell* free_list;
+    size_t next_chunk;
+    size_t live;
+    size_t allocs;
+
+    static const size_t first_chunk = 16;
+    static const size_t max_chunk = 4096;
+
+    Cell* grab();
+
+public:
+    node_pool();
+    node_pool(const node_pool&) = delete;
+    node_pool& operator=(const node_pool&) = delete;
+
+    template <typename... Args>
+    T* make(Args&&... args);
+    void destroy(T* obj);
+
+    size_t live_cnt() const { return live; }
+    size_t chunk_cnt() const { return chunks.size(); }
+    size_t alloc_cnt() const { return allocs; }
+    size_t reserved_bytes() const;
+};
+
+// Implementation
+template <typename T>
+node_pool<T>::node_pool()
+    : bump(nullptr), bump_end(nullptr), free_list(nullptr), next_chunk(first_chunk), live(0), allocs(0) {}
+
+template <typename T>
+typename node_pool<T>::Cell* node_pool<T>::grab() {
+    if (free_list) {
+        Cell* c = free_list;
+        free_list = c->next;
+        return c;
+    }
+    if (bump == bump_end) {
+        chunks.emplace_back(new Cell[next_chunk]);
+        ++allocs;
+        bump = chunks.back().get();
+        bump_end = bump + next_chunk;
+        if (next_chunk < max_chunk) next_chunk *= 2;
+    }
+    return bump++;
+}
+
+template <typename T>
+template <typename... Args>
+T* node_pool<T>::make(Args&&... args) {
+    Cell* c = grab();
+    T* obj;
+    try {
+        obj = new (c->raw) T(std::forward<Args>(args)...);
+    } catch (...) {
+        c->next = free_list;
+        free_list = c;
+        throw;
+    }
+    ++live;
+    return obj;
+}
+
+template <typename T>
+void node_pool<T>::destroy(T* obj) {
+    if (!obj) return;
+    obj->~T();
+    Cell* c = reinterpret_cast<Cell*>(obj);
+    c->next = free_list;
+    free_list = c;
+    --live;
+}
+
+template <typename T>
+size_t node_pool<T>::reserved_bytes() const {
+    size_t cells = 0, n = first_chunk;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        cells += n;
+        if (n < max_chunk) n *= 2;
+    }
+    return cells * sizeof(Cell);
+}
+
+#endif // NODE_POOL_HPP
@@ -0,0 +1,169 @@
+#ifndef PARALLEL_EXEC_HPP
+#define PARALLEL_EXEC_HPP
+
+#include <iostream>
+#include <functional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "commands.hpp"
+#include "file_system.hpp"
+#include "work_pool.hpp"
+
+// Batch execution on a work-stealing pool. Commands that only touch the file
+// they name are queued per file; everything else (CREATE, RENAME, RECENT,
+// BIGGEST, STATS, SEARCH, GC, ...) is a barrier. At a barrier, or when the
+// queues hold max_segment commands, the pending segment runs: each file's
+// queue is one task, so commands on a file keep their order, and different
+// files proceed in parallel. Every command writes into its own cmd_effects
+// buffer; once the segment is done the outputs and deferred updates are
+// applied in input order, so the output is identical to a sequential run.
+// The barrier command itself then runs alone on the calling thread.
+//
+// Each task prints through an ostream of its own (see console()) over a
+// capture_buf, so workers share no stream state.
+class parallel_exec {
+    // Appends to the running command's cmd_effects buffer.
+    class capture_buf : public std::streambuf {
+    protected:
+        int_type overflow(int_type c) override;
+        std::streamsize xsputn(const char* s, std::streamsize n) override;
+    };
+
+    struct queued {
+        size_t off;
+        size_t len;
+        int verb;
+        time_t pin;
+    };
+
+    CommandHandler& handler;
+    file_system& fs;
+    work_pool pool;
+
+    std::string arena;
+    std::vector<queued> cmds;
+    std::vector<cmd_effects> effects;
+    std::vector<std::vector<int>> tasks;
+    std::vector<int> task_handle;
+    std::vector<int> task_of;
+    int used_tasks;
+    int missing_task;
+    int max_segment;
+
+    long long segments;
+    long long task_total;
+
+    std::string_view line_of(const queued& q) const { return std::string_view(arena.data() + q.off, q.len); }
+    int task_for(int handle);
+
+public:
+    parallel_exec(CommandHandler& h, file_system& f, int threads, int max_segment = 4096);
+    ~parallel_exec();
+
+    // Queues or runs one command; false once EXIT has been handled.
+    bool submit(std::string_view cmd_line);
+    // Runs everything still queued.
+    void flush();
+
+    int threads() const { return pool.size(); }
+    long long segment_cnt() const { return segments; }
+    long long task_cnt() const { return task_total; }
+    long long steal_cnt() const { return pool.steal_cnt(); }
+};
+
+// Implementation
+parallel_exec::capture_buf::int_type parallel_exec::capture_buf::overflow(int_type c) {
+    if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+    cmd_effects::current()->out.push_back(traits_type::to_char_type(c));
+    return c;
+}
+
+std::streamsize parallel_exec::capture_buf::xsputn(const char* s, std::streamsize n) {
+    cmd_effects::current()->out.append(s, n);
+    return n;
+}
+
+parallel_exec::parallel_exec(CommandHandler& h, file_system& f, int threads, int max_seg)
+    : handler(h), fs(f), pool(threads), used_tasks(0), missing_task(-1),
+      max_segment(max_seg > 0 ? max_seg : 1), segments(0), task_total(0) {}
+
+parallel_exec::~parallel_exec() {
+    flush();
+}
+
+// Commands naming a file that does not exist only print an error, so they
+// share one task. Task lists are kept between segments to reuse their memory.
+int parallel_exec::task_for(int handle) {
+    int& slot = handle < 0 ? missing_task : task_of[handle];
+    if (slot < 0) {
+        slot = used_tasks++;
+        if (slot == static_cast<int>(tasks.size())) {
+            tasks.emplace_back();
+            task_handle.push_back(handle);
+        }
+        task_handle[slot] = handle;
+    }
+    return slot;
+}
+
+bool parallel_exec::submit(std::string_view cmd_line) {
+    std::string_view name;
+    int verb = CommandHandler::classify(cmd_line, name);
+    if (!CommandHandler::per_file(verb)) {
+        flush();
+        return handler.execute(cmd_line);
+    }
+    int handle = fs.handle_of(name);
+    if (handle >= static_cast<int>(task_of.size())) task_of.resize(handle + 1, -1);
+
+    queued q{arena.size(), cmd_line.size(), verb, handler.admit(cmd_line, verb)};
+    arena.append(cmd_line);
+    int t = task_for(handle);
+    tasks[t].push_back(static_cast<int>(cmds.size()));
+    cmds.push_back(q);
+    // A GC slice prunes whatever it reaches, so it must see exactly the
+    // commands before it: end the segment here and run it alone.
+    if (handler.gc_due(verb)) {
+        flush();
+        handler.gc_tick(q.pin);
+    }
+    else if (static_cast<int>(cmds.size()) >= max_segment) flush();
+    return true;
+}
+
+void parallel_exec::flush() {
+    if (cmds.empty()) return;
+    if (effects.size() < cmds.size()) effects.resize(cmds.size());
+    std::function<void(int)> run_task = [this](int t) {
+        capture_buf buf;
+        std::ostream os(&buf);
+        console_stream() = &os;
+        for (int i : tasks[t]) {
+            cmd_effects::current() = &effects[i];
+            handler.run(line_of(cmds[i]), cmds[i].verb, cmds[i].pin);
+        }
+        cmd_effects::current() = nullptr;
+        console_stream() = nullptr;
+    };
+    pool.run(used_tasks, run_task);
+
+    for (size_t i = 0; i < cmds.size(); ++i) {
+        fs.apply(effects[i], std::cout);
+        effects[i].clear();
+    }
+
+    ++segments;
+    task_total += used_tasks;
+    for (int t = 0; t < used_tasks; ++t) {
+        tasks[t].clear();
+        if (task_handle[t] >= 0) task_of[task_handle[t]] = -1;
+    }
+    used_tasks = 0;
+    missing_task = -1;
+    cmds.clear();
+    arena.clear();
+}
+
+#endif // PARALLEL_EXEC_HPP
@@ -0,0 +1,146 @@
+#ifndef ROPE_HPP
+#define ROPE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+
+// Piece table over shared, append-only buffers. Copying a rope only copies
+// the piece list, and appending extends the last buffer in place whenever
+// nobody else has written past our end of it, so N appends cost O(N) bytes.
+//
+// A buffer that another rope also holds is never reallocated: once it is
+// full the next append starts a new one, up to twice the size. Bytes a copy
+// can see therefore never move, and the copy can be read on one thread while
+// another thread appends to the original (see file::read_shared). A buffer
+// only this rope holds grows in place as usual.
+//
+// A copy that cannot extend its source's buffer (a version made from a
+// sealed snapshot, say) starts a new piece for each append. To keep the
+// piece list short, a new piece absorbs the trailing pieces that are no
+// longer than itself, like carries in a binary counter: a rope holds
+// O(log n) pieces and each byte is copied O(log n) times.
+class rope {
+    struct piece {
+        std::shared_ptr<const std::string> buf;
+        size_t off;
+        size_t len;
+    };
+
+    std::vector<piece> pieces;
+    std::shared_ptr<std::string> add_buf;
+    size_t total;
+
+    static constexpr size_t max_block = 1 << 16;
+
+    bool owns_tail() const;
+
+public:
+    rope();
+    rope(std::string_view text);
+    rope(const char* text);
+
+    void append(std::string_view text);
+    void assign(std::string_view text);
+    void clear();
+    // Forgets the append buffer: appends to this rope, or to copies made from
+    // it, then start a buffer of their own instead of extending a shared one.
+    void seal() { add_buf.reset(); }
+    std::string read() const;
+    std::string tail(size_t n) const;
+    size_t bytes() const;
+    size_t size() const { return total; }
+    bool empty() const { return total == 0; }
+    int piece_cnt() const { return static_cast<int>(pieces.size()); }
+};
+
+// Implementation
+rope::rope() : total(0) {}
+
+rope::rope(std::string_view text) : total(0) {
+    append(text);
+}
+
+rope::rope(const char* text) : rope(std::string_view(text)) {}
+
+bool rope::owns_tail() const {
+    if (pieces.empty() || !add_buf) return false;
+    const piece& last = pieces.back();
+    return last.buf == add_buf && last.off + last.len == add_buf->size();
+}
+
+void rope::append(std::string_view text) {
+    if (text.empty()) return;
+    bool mine = owns_tail();
+    bool fits = mine && add_buf->capacity() - add_buf->size() >= text.size();
+    if (mine && !fits && add_buf.use_count() == 2) {
+        // Only this rope holds the buffer, so it may move. The fence orders
+        // reads by a copy on another thread, released before it let go of
+        // the buffer, ahead of the move.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        fits = true;
+    }
+    if (fits) {
+        add_buf->append(text);
+        pieces.back().len += text.size();
+    } else {
+        // Our buffer is full, someone sharing it already wrote past our end,
+        // or we have none yet: start a new one rather than moving old text.
+        size_t cap = mine ? std::min(2 * add_buf->capacity(), max_block) : 0;
+        size_t keep = pieces.size(), len = text.size();
+        while (keep > 0 && pieces[keep - 1].len <= len) len += pieces[--keep].len;
+        add_buf = std::make_shared<std::string>();
+        add_buf->reserve(std::max(cap, len));
+        for (size_t i = keep; i < pieces.size(); ++i) add_buf->append(pieces[i].buf->data() + pieces[i].off, pieces[i].len);
+        add_buf->append(text);
+        pieces.erase(pieces.begin() + keep, pieces.end());
+        pieces.push_back({add_buf, 0, len});
+    }
+    total += text.size();
+}
+
+void rope::assign(std::string_view text) {
+    clear();
+    append(text);
+}
+
+void rope::clear() {
+    pieces.clear();
+    add_buf.reset();
+    total = 0;
+}
+
+std::string rope::read() const {
+    std::string out;
+    out.reserve(total);
+    for (const piece& p : pieces) {
+        out.append(p.buf->data() + p.off, p.len);
+    }
+    return out;
+}
+
+// The last n bytes (fewer if the rope is shorter), read from the back.
+std::string rope::tail(size_t n) const {
+    std::string out;
+    for (auto it = pieces.rbegin(); it != pieces.rend() && out.size() < n; ++it) {
+        size_t take = std::min(it->len, n - out.size());
+        out.insert(0, it->buf->data() + it->off + it->len - take, take);
+    }
+    return out;
+}
+
+// Shared buffers are charged evenly to every rope holding them. A rope that
+// can still append to a buffer holds it twice (piece and add_buf).
+size_t rope::bytes() const {
+    size_t b = pieces.capacity() * sizeof(piece);
+    for (const piece& p : pieces) {
+        long refs = p.buf.use_count() / (p.buf == add_buf ? 2 : 1);
+        b += p.buf->capacity() / (refs > 0 ? refs : 1);
+    }
+    return b;
+}
+
+#endif // ROPE_HPP
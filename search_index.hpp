@@ -0,0 +1,208 @@
+#ifndef SEARCH_INDEX_HPP
+#define SEARCH_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include "hash_map.hpp"
+
+// Trigram inverted index over documents named by (file handle << 32 |
+// version id). Inside the index each document gets a sequence number in the
+// order it was first seen, so new versions of interleaved files still arrive
+// in increasing order. Each trigram owns a posting list kept as varint
+// deltas of its sorted sequence numbers: in-order ids are appended to the
+// packed bytes directly, the rest (edits of older drafts) wait in a small
+// unsorted tail that is folded in once it grows past a fraction of the list,
+// so inserts stay amortised O(1).
+//
+// The index only ever grows: ids of versions that changed or were pruned
+// stay listed, so its answers are candidates for the caller to verify.
+class trigram_index {
+    struct posting_list {
+        std::string packed;
+        std::uint64_t last = 0;
+        int count = 0;
+        std::vector<std::uint64_t> tail;
+
+        void add(std::uint64_t id);
+        void fold();
+        void decode(std::vector<std::uint64_t>& out);
+    };
+
+    hash_map<std::uint64_t, int> slot_of;
+    std::vector<posting_list> lists;
+    std::vector<std::uint32_t> grams;
+    hash_map<std::uint64_t, int> seq_of;
+    std::vector<std::uint64_t> doc_at;
+
+    int seq(std::uint64_t id);
+
+    static std::uint32_t gram_at(const char* p) {
+        return (std::uint32_t(static_cast<unsigned char>(p[0])) << 16)
+             | (std::uint32_t(static_cast<unsigned char>(p[1])) << 8)
+             | std::uint32_t(static_cast<unsigned char>(p[2]));
+    }
+    static void put_varint(std::string& out, std::uint64_t v);
+    static std::uint64_t get_varint(const std::string& in, size_t& pos);
+
+public:
+    static std::uint64_t doc_id(int handle, int version) {
+        return (std::uint64_t(static_cast<std::uint32_t>(handle)) << 32) | static_cast<std::uint32_t>(version);
+    }
+    static int doc_handle(std::uint64_t id) { return static_cast<int>(id >> 32); }
+    static int doc_version(std::uint64_t id) { return static_cast<int>(id & 0xffffffffu); }
+
+    // Lists id under every distinct trigram of p[0, n).
+    void add(std::uint64_t id, const char* p, size_t n);
+    void add(std::uint64_t id, const std::string& text) { add(id, text.data(), text.size()); }
+
+    // Ids of documents holding every trigram of pattern, in the order they
+    // were first indexed. False when the pattern is shorter than a trigram
+    // and cannot be narrowed.
+    bool candidates(const std::string& pattern, std::vector<std::uint64_t>& out);
+
+    int trigram_cnt() const { return static_cast<int>(lists.size()); }
+    long long posting_cnt() const;
+    size_t bytes() const;
+};
+
+// Implementation
+void trigram_index::put_varint(std::string& out, std::uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+std::uint64_t trigram_index::get_varint(const std::string& in, size_t& pos) {
+    std::uint64_t v = 0;
+    for (int shift = 0; pos < in.size(); shift += 7) {
+        unsigned char b = static_cast<unsigned char>(in[pos++]);
+        v |= std::uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+    }
+    return v;
+}
+
+void trigram_index::posting_list::add(std::uint64_t id) {
+    if (tail.empty() && (count == 0 || id > last)) {
+        put_varint(packed, count == 0 ? id : id - last);
+        last = id;
+        ++count;
+        return;
+    }
+    if (tail.empty() && id == last) return;
+    tail.push_back(id);
+    if (tail.size() > 8 + static_cast<size_t>(count) / 4) fold();
+}
+
+void trigram_index::posting_list::fold() {
+    if (tail.empty()) return;
+    std::vector<std::uint64_t> ids;
+    ids.reserve(count);
+    size_t pos = 0;
+    std::uint64_t cur = 0;
+    for (int i = 0; i < count; ++i) {
+        cur += get_varint(packed, pos);
+        ids.push_back(cur);
+    }
+    std::sort(tail.begin(), tail.end());
+    std::vector<std::uint64_t> merged;
+    merged.reserve(ids.size() + tail.size());
+    std::merge(ids.begin(), ids.end(), tail.begin(), tail.end(), std::back_inserter(merged));
+    merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+    std::vector<std::uint64_t>().swap(tail);
+
+    packed.clear();
+    std::uint64_t prev = 0;
+    for (std::uint64_t id : merged) {
+        put_varint(packed, id - prev);
+        prev = id;
+    }
+    count = static_cast<int>(merged.size());
+    last = prev;
+}
+
+void trigram_index::posting_list::decode(std::vector<std::uint64_t>& out) {
+    fold();
+    out.clear();
+    out.reserve(count);
+    size_t pos = 0;
+    std::uint64_t cur = 0;
+    for (int i = 0; i < count; ++i) {
+        cur += get_varint(packed, pos);
+        out.push_back(cur);
+    }
+}
+
+int trigram_index::seq(std::uint64_t id) {
+    int s;
+    if (seq_of.find(id, s)) return s;
+    s = static_cast<int>(doc_at.size());
+    doc_at.push_back(id);
+    seq_of.ins(id, s);
+    return s;
+}
+
+void trigram_index::add(std::uint64_t id, const char* p, size_t n) {
+    if (n < 3) return;
+    std::uint64_t doc = seq(id);
+    grams.clear();
+    for (size_t i = 0; i + 3 <= n; ++i) grams.push_back(gram_at(p + i));
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    for (std::uint32_t g : grams) {
+        int s;
+        if (!slot_of.find(g, s)) {
+            s = static_cast<int>(lists.size());
+            lists.emplace_back();
+            slot_of.ins(g, s);
+        }
+        lists[s].add(doc);
+    }
+}
+
+// Intersects the lists rarest first, so the candidate set only shrinks.
+bool trigram_index::candidates(const std::string& pattern, std::vector<std::uint64_t>& out) {
+    out.clear();
+    if (pattern.size() < 3) return false;
+    std::vector<int> slots;
+    for (size_t i = 0; i + 3 <= pattern.size(); ++i) {
+        int s;
+        if (!slot_of.find(gram_at(pattern.data() + i), s)) return true;
+        slots.push_back(s);
+    }
+    std::sort(slots.begin(), slots.end());
+    slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+    for (int s : slots) lists[s].fold();
+    std::sort(slots.begin(), slots.end(), [this](int x, int y) { return lists[x].count < lists[y].count; });
+
+    lists[slots[0]].decode(out);
+    std::vector<std::uint64_t> next, kept;
+    for (size_t k = 1; k < slots.size() && !out.empty(); ++k) {
+        lists[slots[k]].decode(next);
+        kept.clear();
+        std::set_intersection(out.begin(), out.end(), next.begin(), next.end(), std::back_inserter(kept));
+        out.swap(kept);
+    }
+    for (std::uint64_t& d : out) d = doc_at[d];
+    return true;
+}
+
+long long trigram_index::posting_cnt() const {
+    long long n = 0;
+    for (const posting_list& pl : lists) n += pl.count + static_cast<long long>(pl.tail.size());
+    return n;
+}
+
+size_t trigram_index::bytes() const {
+    size_t b = lists.capacity() * sizeof(posting_list) + grams.capacity() * sizeof(std::uint32_t) + slot_of.bytes()
+             + seq_of.bytes() + doc_at.capacity() * sizeof(std::uint64_t);
+    for (const posting_list& pl : lists) b += pl.packed.capacity() + pl.tail.capacity() * sizeof(std::uint64_t);
+    return b;
+}
+
+#endif // SEARCH_INDEX_HPP
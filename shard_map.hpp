@@ -0,0 +1,271 @@
+#ifndef SHARD_MAP_HPP
+#define SHARD_MAP_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include "epoch.hpp"
+#include "hash.hpp"
+
+// Concurrent counterpart of hash_map for lookups that must never block.
+// Keys are spread over shard_cnt shards by the top bits of their hash; each
+// shard is a power-of-two array of bucket chains. Writers lock the one shard
+// they change and make every change visible with a single atomic store: a
+// new node is fully built before it is linked in, a removed or replaced node
+// is unlinked and retired to the epoch domain, and growth builds a complete
+// new array (with copied nodes) before swapping it in. Readers take no lock;
+// inside an epoch guard they see a chain either before or after each store.
+//
+// A rename moves an entry between two shards, which a reader could observe
+// half done. Renames therefore bump a sequence counter before and after the
+// move, and a lookup that overlaps one is retried, so a renamed key is
+// always found under exactly one of its two names.
+template <typename K, typename V, typename H = default_hash<K>>
+class shard_map {
+    template <typename Q>
+    using if_view = std::enable_if_t<std::is_same<K, std::string>::value
+                                     && !std::is_same<std::decay_t<Q>, K>::value
+                                     && std::is_convertible<const Q&, std::string_view>::value>;
+
+    struct node {
+        K key;
+        V value;
+        size_t hash;
+        std::atomic<node*> next;
+
+        node(const K& k, const V& v, size_t h, node* n) : key(k), value(v), hash(h), next(n) {}
+    };
+
+    struct table {
+        size_t mask;
+        std::unique_ptr<std::atomic<node*>[]> heads;
+
+        explicit table(size_t buckets);
+        static void destroy(void* p);
+    };
+
+    struct alignas(64) shard {
+        std::mutex m;
+        std::atomic<table*> tab;
+        std::atomic<int> size{0};
+    };
+
+    static const int shard_bits = 6;
+    static const int shard_cnt = 1 << shard_bits;
+
+    shard shards[shard_cnt];
+    std::mutex rename_m;
+    std::atomic<unsigned> rename_seq{0};
+    H hasher;
+
+    static int shard_of(size_t h) { return static_cast<int>(static_cast<std::uint64_t>(h) >> (64 - shard_bits)); }
+    template <typename Q>
+    bool find_hashed(const Q& key, size_t h, V& value_out) const;
+    template <typename Q>
+    std::atomic<node*>* link_of(shard& s, const Q& key, size_t h);
+    void put(shard& s, const K& key, const V& value, size_t h);
+    bool drop(shard& s, const K& key, size_t h);
+    void grow(shard& s);
+
+public:
+    shard_map();
+    ~shard_map();
+    shard_map(const shard_map&) = delete;
+    shard_map& operator=(const shard_map&) = delete;
+
+    void ins(const K& key, const V& value);
+    bool find(const K& key, V& value_out) const { return find_hashed(key, hasher(key), value_out); }
+    bool rm(const K& key);
+    // Moves from's value to the key to; false (and no change) when from is
+    // missing or to is already taken.
+    bool rename(const K& from, const K& to);
+
+    template <typename Q, typename = if_view<Q>>
+    bool find(const Q& key, V& value_out) const {
+        std::string_view k(key);
+        return find_hashed(k, hasher(k), value_out);
+    }
+
+    int get_size() const;
+
+    // Visits one shard at a time under its lock; func gets a copy of each
+    // value, as in hash_map::iterate.
+    template <typename Func>
+    void iterate(Func func);
+};
+
+// Implementation
+template <typename K, typename V, typename H>
+shard_map<K,V,H>::table::table(size_t buckets) : mask(buckets - 1), heads(new std::atomic<node*>[buckets]) {
+    for (size_t i = 0; i < buckets; ++i) heads[i].store(nullptr, std::memory_order_relaxed);
+}
+
+template <typename K, typename V, typename H>
+void shard_map<K,V,H>::table::destroy(void* p) {
+    table* t = static_cast<table*>(p);
+    for (size_t i = 0; i <= t->mask; ++i) {
+        node* n = t->heads[i].load(std::memory_order_relaxed);
+        while (n) {
+            node* next = n->next.load(std::memory_order_relaxed);
+            delete n;
+            n = next;
+        }
+    }
+    delete t;
+}
+
+template <typename K, typename V, typename H>
+shard_map<K,V,H>::shard_map() {
+    for (shard& s : shards) s.tab.store(new table(8), std::memory_order_relaxed);
+}
+
+template <typename K, typename V, typename H>
+shard_map<K,V,H>::~shard_map() {
+    for (shard& s : shards) table::destroy(s.tab.load(std::memory_order_relaxed));
+}
+
+template <typename K, typename V, typename H>
+template <typename Q>
+bool shard_map<K,V,H>::find_hashed(const Q& key, size_t h, V& value_out) const {
+    const shard& s = shards[shard_of(h)];
+    epoch_domain::guard g;
+    for (;;) {
+        unsigned seq = rename_seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        const table* t = s.tab.load(std::memory_order_acquire);
+        const node* n = t->heads[h & t->mask].load(std::memory_order_acquire);
+        while (n && !(n->hash == h && n->key == key)) n = n->next.load(std::memory_order_acquire);
+        if (n) value_out = n->value;
+        // The chain was walked with acquire loads, so this load cannot be
+        // satisfied before them.
+        if (rename_seq.load(std::memory_order_acquire) == seq) return n != nullptr;
+    }
+}
+
+// The link pointing at key's node, or nullptr when the key is absent. The
+// caller holds the shard's lock.
+template <typename K, typename V, typename H>
+template <typename Q>
+std::atomic<typename shard_map<K,V,H>::node*>* shard_map<K,V,H>::link_of(shard& s, const Q& key, size_t h) {
+    table* t = s.tab.load(std::memory_order_relaxed);
+    std::atomic<node*>* link = &t->heads[h & t->mask];
+    for (node* n = link->load(std::memory_order_relaxed); n; n = link->load(std::memory_order_relaxed)) {
+        if (n->hash == h && n->key == key) return link;
+        link = &n->next;
+    }
+    return nullptr;
+}
+
+template <typename K, typename V, typename H>
+void shard_map<K,V,H>::put(shard& s, const K& key, const V& value, size_t h) {
+    if (std::atomic<node*>* link = link_of(s, key, h)) {
+        node* old = link->load(std::memory_order_relaxed);
+        link->store(new node(key, value, h, old->next.load(std::memory_order_relaxed)), std::memory_order_release);
+        epoch_domain::global().retire(old);
+        return;
+    }
+    table* t = s.tab.load(std::memory_order_relaxed);
+    if (static_cast<size_t>(s.size.load(std::memory_order_relaxed)) > t->mask) {
+        grow(s);
+        t = s.tab.load(std::memory_order_relaxed);
+    }
+    std::atomic<node*>& head = t->heads[h & t->mask];
+    head.store(new node(key, value, h, head.load(std::memory_order_relaxed)), std::memory_order_release);
+    s.size.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename K, typename V, typename H>
+bool shard_map<K,V,H>::drop(shard& s, const K& key, size_t h) {
+    std::atomic<node*>* link = link_of(s, key, h);
+    if (!link) return false;
+    node* gone = link->load(std::memory_order_relaxed);
+    link->store(gone->next.load(std::memory_order_relaxed), std::memory_order_release);
+    epoch_domain::global().retire(gone);
+    s.size.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+// Readers may still be walking the old chains, so they are copied rather
+// than relinked, and the old array goes to the epoch domain with its nodes.
+template <typename K, typename V, typename H>
+void shard_map<K,V,H>::grow(shard& s) {
+    table* old = s.tab.load(std::memory_order_relaxed);
+    table* t = new table((old->mask + 1) * 2);
+    for (size_t i = 0; i <= old->mask; ++i) {
+        for (node* n = old->heads[i].load(std::memory_order_relaxed); n; n = n->next.load(std::memory_order_relaxed)) {
+            std::atomic<node*>& head = t->heads[n->hash & t->mask];
+            head.store(new node(n->key, n->value, n->hash, head.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+        }
+    }
+    s.tab.store(t, std::memory_order_release);
+    epoch_domain::global().retire(old, &table::destroy);
+}
+
+template <typename K, typename V, typename H>
+void shard_map<K,V,H>::ins(const K& key, const V& value) {
+    size_t h = hasher(key);
+    shard& s = shards[shard_of(h)];
+    std::lock_guard<std::mutex> hold(s.m);
+    put(s, key, value, h);
+}
+
+template <typename K, typename V, typename H>
+bool shard_map<K,V,H>::rm(const K& key) {
+    size_t h = hasher(key);
+    shard& s = shards[shard_of(h)];
+    std::lock_guard<std::mutex> hold(s.m);
+    return drop(s, key, h);
+}
+
+// Shards are locked in index order, after rename_m, so renames cannot
+// deadlock with each other or with single-shard writers.
+template <typename K, typename V, typename H>
+bool shard_map<K,V,H>::rename(const K& from, const K& to) {
+    size_t hf = hasher(from), ht = hasher(to);
+    int a = shard_of(hf), b = shard_of(ht);
+    std::lock_guard<std::mutex> order(rename_m);
+    std::unique_lock<std::mutex> first(shards[a < b ? a : b].m);
+    std::unique_lock<std::mutex> second;
+    if (a != b) second = std::unique_lock<std::mutex>(shards[a < b ? b : a].m);
+
+    std::atomic<node*>* link = link_of(shards[a], from, hf);
+    if (!link || link_of(shards[b], to, ht)) return false;
+    V value = link->load(std::memory_order_relaxed)->value;
+    rename_seq.fetch_add(1);
+    put(shards[b], to, value, ht);
+    drop(shards[a], from, hf);
+    rename_seq.fetch_add(1);
+    return true;
+}
+
+template <typename K, typename V, typename H>
+int shard_map<K,V,H>::get_size() const {
+    int n = 0;
+    for (const shard& s : shards) n += s.size.load(std::memory_order_relaxed);
+    return n;
+}
+
+template <typename K, typename V, typename H>
+template <typename Func>
+void shard_map<K,V,H>::iterate(Func func) {
+    for (shard& s : shards) {
+        std::lock_guard<std::mutex> hold(s.m);
+        table* t = s.tab.load(std::memory_order_relaxed);
+        for (size_t i = 0; i <= t->mask; ++i) {
+            for (node* n = t->heads[i].load(std::memory_order_relaxed); n; n = n->next.load(std::memory_order_relaxed)) {
+                V value = n->value;
+                func(n->key, value);
+            }
+        }
+    }
+}
+
+#endif // SHARD_MAP_HPP
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Restart from a checkpoint plus the journal written after it: the commands
+# the checkpoint already holds must not be applied a second time.
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+src=$(cd "$(dirname "$0")" && pwd)
+g++ -std=c++17 -Wall -Wextra "$src/main.cpp" -o "$dir/fvs" || { echo "Compilation failed."; exit 1; }
+cd "$dir"
+
+fail=0
+check() {
+    # $1: description, $2: expected line, remaining: program arguments
+    local what=$1 want=$2
+    shift 2
+    local got
+    got=$(printf 'OFF\nREAD a\nEXIT\n' | ./fvs "$@" | grep "^'a' : ")
+    if [ "$got" == "$want" ]; then
+        echo "ok   $what"
+    else
+        echo "FAIL $what: expected \"$want\", got \"$got\""
+        fail=1
+    fi
+}
+
+printf 'OFF\nCREATE a\nINSERT a hello\nSNAPSHOT a s1\nCHECKPOINT ck1\nINSERT a world\nEXIT\n' \
+    | ./fvs --journal j.log > /dev/null
+
+check "journal alone" "'a' : helloworld" --journal j.log
+check "checkpoint plus journal" "'a' : helloworld" --load ck1 --journal j.log
+
+# A second session on top of the first, checkpointed again at its end.
+printf 'OFF\nINSERT a !\nCHECKPOINT ck2\nEXIT\n' | ./fvs --load ck1 --journal j.log > /dev/null
+check "second checkpoint plus journal" "'a' : helloworld!" --load ck2 --journal j.log
+check "first checkpoint plus longer journal" "'a' : helloworld!" --load ck1 --journal j.log
+
+# A journal that was not written after the checkpoint is replayed whole.
+printf 'OFF\nINSERT a ?\nEXIT\n' | ./fvs --load ck1 --journal other.log > /dev/null
+check "checkpoint plus unrelated journal" "'a' : hello?" --load ck1 --journal other.log
+
+exit $fail
@@ -2,27 +2,117 @@
 #define TREE_NODE_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <algorithm>
 #include <ctime>
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include "rope.hpp"
+#include "blob_store.hpp"
 
 class file;
 
+// Journal replay pins the clock so restored versions keep their original times.
+// The pin is per thread: the parallel batch engine pins each command's time on
+// whichever worker runs it.
+time_t& pinned_ts() {
+    static thread_local time_t t = 0;
+    return t;
+}
+
+time_t now_ts() {
+    return pinned_ts() ? pinned_ts() : std::time(nullptr);
+}
+
+// Where commands print: std::cout, unless the thread has been given a stream
+// of its own. The parallel batch engine gives each worker one, so workers
+// never share std::cout's formatting and error state.
+std::ostream*& console_stream() {
+    static thread_local std::ostream* os = nullptr;
+    return os;
+}
+
+std::ostream& console() {
+    std::ostream* os = console_stream();
+    return os ? *os : std::cout;
+}
+
+// Local time as "YYYY-MM-DD HH:MM:SS", the form parse_ts reads back.
+std::string fmt_ts(time_t t) {
+    char buf[32];
+    std::tm tm_buf = {};
+    localtime_r(&t, &tm_buf);
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm_buf);
+    return buf;
+}
+
+// A duration in milliseconds to three decimals ("0.096"), for the timings in
+// command reports; formatted apart so the console keeps its default flags.
+std::string fmt_ms(double ms) {
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(3) << ms;
+    return os.str();
+}
+
+// Accepts seconds since the epoch or local "YYYY-MM-DD[ T]HH:MM[:SS]".
+bool parse_ts(const std::string& text, time_t& out) {
+    size_t b = text.find_first_not_of(" \t"), e = text.find_last_not_of(" \t");
+    if (b == std::string::npos) return false;
+    std::string s = text.substr(b, e - b + 1);
+    if (s.find_first_not_of("0123456789") == std::string::npos) {
+        out = static_cast<time_t>(std::stoll(s));
+        return true;
+    }
+    if (s.size() > 10 && s[10] == 'T') s[10] = ' ';
+    for (const char* f : {"%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M"}) {
+        std::tm tm_buf = {};
+        std::istringstream in(s);
+        in >> std::get_time(&tm_buf, f);
+        if (in.fail() || in.peek() != EOF) continue;
+        tm_buf.tm_isdst = -1;
+        out = std::mktime(&tm_buf);
+        return out != -1;
+    }
+    return false;
+}
+
 class tree_node {
     friend class file;
 public: //private
     int version_id;
-    std::string content;
+    rope content;
+    blob_ref blob;
     std::string message;
     const time_t created_ts;
     time_t last_mod_ts;
     time_t ss_ts;
     tree_node* parent;
-    std::vector<tree_node*> children;
+    // Children form an intrusive singly linked list in creation order, so a
+    // node needs no separate heap block for them.
+    tree_node* first_child;
+    tree_node* last_child;
+    tree_node* next_sibling;
+    int n_children;
+    // Snapshots move their text into the shared blob store, unless they are
+    // delta-encoded: such a node keeps no content of its own, its text is
+    // parent[0, d_pre) + d_mid + the last d_suf bytes of parent.
+    bool is_delta;
+    size_t d_pre;
+    size_t d_suf;
+    std::string d_mid;
+    int kf_dist;
+    // Skew-binary jump pointer: with depth, it finds any ancestor in
+    // O(log depth) using O(1) extra space per node.
+    int depth;
+    tree_node* jump;
+    // Nearest strict ancestor that is a snapshot, so HISTORY can hop from
+    // snapshot to snapshot.
+    tree_node* ss_up;
 
 //public:
-    tree_node(int id, const std::string& cont, tree_node* par);
+    tree_node(int id, const rope& cont, tree_node* par);
     tree_node(int id, const std::string& cont);
     tree_node(int id);
     tree_node();
@@ -32,26 +122,77 @@ public: //private
     bool rm_child(tree_node* child);
     int child_cnt() const;
     std::vector<tree_node*> rootpath();
+    void link_jump();
+    tree_node* ancestor_at(int d);
+    bool is_ancestor_of(tree_node* node);
+    static tree_node* lca(tree_node* a, tree_node* b);
     bool is_ss() const;
-    void upd_cont(const std::string& new_cont);
-    void upd_msg(const std::string& new_msg);
+    void upd_cont(std::string_view new_cont);
+    void app_cont(std::string_view more);
+    bool encode_delta();
+    void freeze(int kf_every);
+    rope get_rope() const;
+    size_t stored_bytes() const;
+    void upd_msg(std::string_view new_msg);
     time_t get_created_ts() const;
     time_t get_last_mod_ts() const;
     void set_ss_ts(time_t t);
     time_t get_ss_ts() const;
 
     // Public getter for content
-    std::string get_content() const { return content; }
+    std::string get_content() const;
 };
 
 using tn = tree_node;
 
+// Renders the subtree under top in preorder with an explicit stack, so depth
+// is bounded by memory rather than the call stack. The box-drawing prefix is
+// one string that grows and shrinks in place; plen[d] is its length at depth
+// d. emit(out, node, prefix, is_last, expanded) appends a node's lines to out,
+// which is handed to os in large blocks. Children below max_depth (none when
+// max_depth < 0) are not expanded.
+template <typename Emit>
+void render_tree(std::ostream& os, tree_node* top, int max_depth, Emit emit) {
+    if (!top) return;
+    const size_t block = 1 << 22;
+    std::string out, prefix;
+    out.reserve(block + 4096);
+    std::vector<size_t> plen(1, 0);
+    std::vector<std::pair<tree_node*, int>> stack;
+    stack.push_back({top, 0});
+    while (!stack.empty()) {
+        tree_node* node = stack.back().first;
+        int d = stack.back().second;
+        stack.pop_back();
+        prefix.resize(plen[d]);
+        bool is_last = node == top || !node->next_sibling;
+        bool expanded = node->first_child && (max_depth < 0 || d < max_depth);
+        emit(out, node, prefix, is_last, expanded);
+        if (out.size() >= block) {
+            os.write(out.data(), out.size());
+            out.clear();
+        }
+        if (!expanded) continue;
+        prefix += is_last ? "    " : "│   ";
+        if ((int)plen.size() <= d + 1) plen.resize(d + 2);
+        plen[d + 1] = prefix.size();
+        size_t first = stack.size();
+        for (tree_node* c = node->first_child; c; c = c->next_sibling) stack.push_back({c, d + 1});
+        std::reverse(stack.begin() + first, stack.end());
+    }
+    os.write(out.data(), out.size());
+}
+
 // Implementation
-tn::tree_node(int id, const std::string& cont, tree_node* par)
-    : version_id(id) , content(cont) , message("") , created_ts(std::time(nullptr)) , last_mod_ts(created_ts) , ss_ts(0) , parent(par){}
+tn::tree_node(int id, const rope& cont, tree_node* par)
+    : version_id(id) , content(cont) , message("") , created_ts(now_ts()) , last_mod_ts(created_ts) , ss_ts(0) , parent(par)
+    , first_child(nullptr) , last_child(nullptr) , next_sibling(nullptr) , n_children(0)
+    , is_delta(false) , d_pre(0) , d_suf(0) , kf_dist(0) , depth(0) , jump(this) , ss_up(nullptr) {
+    link_jump();
+}
 
 tn::tree_node(int id, const std::string& cont)
-    : tree_node(id, cont, nullptr) {}
+    : tree_node(id, rope(cont), nullptr) {}
 
 tn::tree_node(int id)
     : tree_node(id, "", nullptr) {}
@@ -59,26 +200,33 @@ tn::tree_node(int id)
 tn::tree_node()
     : tree_node(0, "", nullptr) {}
 
-tn::~tree_node() {
-    for (auto child : children) {
-        delete child;
-    }
-    children.clear();
-}
+// Nodes are owned by their file's node pool, which destroys them; a node
+// never frees its children.
+tn::~tree_node() {}
 
 void tn::add_child(tree_node* child) {
     if (child) {
         child->parent = this;
-        children.push_back(child);
+        child->next_sibling = nullptr;
+        child->link_jump();
+        if (last_child) last_child->next_sibling = child;
+        else first_child = child;
+        last_child = child;
+        ++n_children;
     }
 }
 
+// Unlinks child from this node; the caller disposes of it.
 bool tn::rm_child(tree_node* child) {
-    for (auto it = children.begin(); it != children.end(); ++it) {
-        if (*it == child) {
-            children.erase(it);
-            child->parent = nullptr;
-            delete child;
+    tree_node* prev = nullptr;
+    for (tree_node* c = first_child; c; prev = c, c = c->next_sibling) {
+        if (c == child) {
+            if (prev) prev->next_sibling = c->next_sibling;
+            else first_child = c->next_sibling;
+            if (last_child == c) last_child = prev;
+            c->next_sibling = nullptr;
+            c->parent = nullptr;
+            --n_children;
             return true;
         }
     }
@@ -86,7 +234,7 @@ bool tn::rm_child(tree_node* child) {
 }
 
 int tn::child_cnt() const {
-    return static_cast<int>(children.size());
+    return n_children;
 }
 
 std::vector<tree_node*> tn::rootpath() {
@@ -100,18 +248,127 @@ std::vector<tree_node*> tn::rootpath() {
     return path;
 }
 
+// Myers' skew-binary rule: if the parent's jump spans the same distance as
+// its jump's jump, merge the two spans; otherwise restart with the parent.
+void tn::link_jump() {
+    if (!parent) {
+        depth = 0;
+        jump = this;
+        ss_up = nullptr;
+        return;
+    }
+    ss_up = parent->is_ss() ? parent : parent->ss_up;
+    depth = parent->depth + 1;
+    tree_node* pj = parent->jump;
+    if (parent->depth - pj->depth == pj->depth - pj->jump->depth) jump = pj->jump;
+    else jump = parent;
+}
+
+tree_node* tn::ancestor_at(int d) {
+    if (d < 0 || d > depth) return nullptr;
+    tree_node* cur = this;
+    while (cur->depth > d) {
+        cur = cur->jump->depth >= d ? cur->jump : cur->parent;
+    }
+    return cur;
+}
+
+bool tn::is_ancestor_of(tree_node* node) {
+    return node && depth <= node->depth && node->ancestor_at(depth) == this;
+}
+
+// Nodes at equal depth have jumps of equal length, so both sides can take
+// the same jump whenever it stays below their meeting point.
+tree_node* tn::lca(tree_node* a, tree_node* b) {
+    if (!a || !b) return nullptr;
+    if (a->depth > b->depth) a = a->ancestor_at(b->depth);
+    else if (b->depth > a->depth) b = b->ancestor_at(a->depth);
+    while (a != b) {
+        if (a->jump != b->jump) {
+            a = a->jump;
+            b = b->jump;
+        } else {
+            a = a->parent;
+            b = b->parent;
+        }
+        if (!a || !b) return nullptr;
+    }
+    return a;
+}
+
 bool tn::is_ss() const {
     return ss_ts != 0;
 }
 
-void tn::upd_cont(const std::string& new_cont) {
-    content = new_cont;
-    last_mod_ts = std::time(nullptr);
+void tn::upd_cont(std::string_view new_cont) {
+    content.assign(new_cont);
+    last_mod_ts = now_ts();
+}
+
+void tn::app_cont(std::string_view more) {
+    content.append(more);
+    last_mod_ts = now_ts();
+}
+
+void tn::upd_msg(std::string_view new_msg) {
+    message.assign(new_msg);
+    last_mod_ts = now_ts();
+}
+
+// Stores this node as an edit of its parent; false when nothing is shared.
+bool tn::encode_delta() {
+    std::string base = parent->get_content();
+    std::string cur = content.read();
+    size_t lim = std::min(base.size(), cur.size());
+    size_t pre = 0;
+    while (pre < lim && base[pre] == cur[pre]) ++pre;
+    size_t suf = 0;
+    while (suf < lim - pre && base[base.size() - 1 - suf] == cur[cur.size() - 1 - suf]) ++suf;
+    size_t mid_len = cur.size() - pre - suf;
+    if (mid_len >= cur.size()) return false;
+
+    d_pre = pre;
+    d_suf = suf;
+    d_mid = cur.substr(pre, mid_len);
+    is_delta = true;
+    kf_dist = parent->kf_dist + 1;
+    content.clear();
+    return true;
 }
 
-void tn::upd_msg(const std::string& new_msg) {
-    message = new_msg;
-    last_mod_ts = std::time(nullptr);
+// Called once, when the node first becomes a snapshot. Its parent is always a
+// snapshot already, so the delta base can never change underneath it.
+void tn::freeze(int kf_every) {
+    if (is_delta || blob) return;
+    if (parent && kf_every > 1 && parent->kf_dist + 1 < kf_every && encode_delta()) return;
+    blob = blob_ref(content);
+    content.clear();
+}
+
+std::string tn::get_content() const {
+    if (!is_delta) return blob ? blob.read() : content.read();
+    std::vector<const tree_node*> chain;
+    const tree_node* cur = this;
+    while (cur->is_delta) {
+        chain.push_back(cur);
+        cur = cur->parent;
+    }
+    std::string text = cur->blob ? cur->blob.read() : cur->content.read();
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        const tree_node* d = *it;
+        text.replace(d->d_pre, text.size() - d->d_pre - d->d_suf, d->d_mid);
+    }
+    return text;
+}
+
+rope tn::get_rope() const {
+    if (is_delta) return rope(get_content());
+    return blob ? blob.data() : content;
+}
+
+size_t tn::stored_bytes() const {
+    return sizeof(tree_node) + message.capacity() + d_mid.capacity()
+         + content.bytes() + blob.bytes();
 }
 
 time_t tn::get_created_ts() const {
@@ -122,8 +379,21 @@ time_t tn::get_last_mod_ts() const {
     return last_mod_ts;
 }
 
+// Descendants that skipped over this node now stop at it. Only unsnapshotted
+// nodes can have pointed past it, and those are always leaves here.
 void tn::set_ss_ts(time_t t) {
+    bool was_ss = is_ss();
     ss_ts = t;
+    if (was_ss || !t) return;
+    std::vector<tree_node*> stack;
+    for (tree_node* c = first_child; c; c = c->next_sibling) stack.push_back(c);
+    while (!stack.empty()) {
+        tree_node* node = stack.back();
+        stack.pop_back();
+        node->ss_up = this;
+        if (node->is_ss()) continue;
+        for (tree_node* c = node->first_child; c; c = c->next_sibling) stack.push_back(c);
+    }
 }
 
 time_t tn::get_ss_ts() const {
@@ -0,0 +1,140 @@
+#ifndef WORK_POOL_HPP
+#define WORK_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that runs rounds of independent tasks. Every
+// participant owns a deque of task ids: it takes work from the back of its
+// own deque and, once that runs dry, steals from the front of the others'.
+// The thread calling run() takes part as participant 0, so a pool of size 1
+// starts no threads and runs everything inline.
+class work_pool {
+    struct task_queue {
+        std::mutex m;
+        std::deque<int> ids;
+    };
+
+    std::vector<std::unique_ptr<task_queue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex m;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    const std::function<void(int)>* job;
+    long long round;
+    int busy;
+    bool stopping;
+    std::atomic<long long> steals;
+
+    bool take(int self, int& id);
+    void work(int self);
+    void loop(int self);
+
+public:
+    explicit work_pool(int n);
+    ~work_pool();
+    work_pool(const work_pool&) = delete;
+    work_pool& operator=(const work_pool&) = delete;
+
+    // Calls fn(i) for every i in [0, task_cnt) across the pool and returns
+    // once all of them have finished.
+    void run(int task_cnt, const std::function<void(int)>& fn);
+
+    int size() const { return static_cast<int>(queues.size()); }
+    long long steal_cnt() const { return steals.load(std::memory_order_relaxed); }
+};
+
+// Implementation
+work_pool::work_pool(int n) : job(nullptr), round(0), busy(0), stopping(false), steals(0) {
+    if (n < 1) n = 1;
+    for (int i = 0; i < n; ++i) queues.emplace_back(new task_queue);
+    for (int i = 1; i < n; ++i) threads.emplace_back(&work_pool::loop, this, i);
+}
+
+work_pool::~work_pool() {
+    {
+        std::lock_guard<std::mutex> hold(m);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads) t.join();
+}
+
+bool work_pool::take(int self, int& id) {
+    {
+        task_queue& own = *queues[self];
+        std::lock_guard<std::mutex> hold(own.m);
+        if (!own.ids.empty()) {
+            id = own.ids.back();
+            own.ids.pop_back();
+            return true;
+        }
+    }
+    int n = size();
+    for (int k = 1; k < n; ++k) {
+        task_queue& victim = *queues[(self + k) % n];
+        std::lock_guard<std::mutex> hold(victim.m);
+        if (!victim.ids.empty()) {
+            id = victim.ids.front();
+            victim.ids.pop_front();
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Tasks never create tasks, so once every deque is empty this participant
+// has nothing left to do in the round.
+void work_pool::work(int self) {
+    int id;
+    while (take(self, id)) (*job)(id);
+}
+
+void work_pool::loop(int self) {
+    long long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> hold(m);
+            wake.wait(hold, [&] { return stopping || round != seen; });
+            if (stopping) return;
+            seen = round;
+        }
+        work(self);
+        std::lock_guard<std::mutex> hold(m);
+        if (--busy == 0) idle.notify_one();
+    }
+}
+
+void work_pool::run(int task_cnt, const std::function<void(int)>& fn) {
+    if (task_cnt <= 0) return;
+    int n = size();
+    for (int i = 0; i < task_cnt; ++i) {
+        task_queue& q = *queues[i % n];
+        std::lock_guard<std::mutex> hold(q.m);
+        q.ids.push_back(i);
+    }
+    job = &fn;
+    if (n > 1) {
+        {
+            std::lock_guard<std::mutex> hold(m);
+            busy = n - 1;
+            ++round;
+        }
+        wake.notify_all();
+    }
+    work(0);
+    if (n > 1) {
+        std::unique_lock<std::mutex> hold(m);
+        idle.wait(hold, [this] { return busy == 0; });
+    }
+    job = nullptr;
+}
+
+#endif // WORK_POOL_HPP